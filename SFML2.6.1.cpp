@@ -10,6 +10,56 @@
 #include <sstream>
 #include <iomanip>
 #include <map>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <initializer_list>
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cmath>
+#include <new>
+#include <utility>
+#include <filesystem>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__BMI__)
+#include <immintrin.h> // tzcnt/blsr for the 64-bit bitboards
+#endif
+
+// arial.ttf compiled in; regenerate with:
+//   xxd -i arial.ttf | sed 's/^unsigned/static const unsigned/' > arial_ttf.h
+#include "arial_ttf.h"
 
 using namespace sf;
 using namespace std;
@@ -17,6 +67,7 @@ using namespace std;
 constexpr int WINDOW_W = 600;
 constexpr int WINDOW_H = 840;
 constexpr int BOARD_SIZE = 3;
+constexpr int WIN_LENGTH = 3;
 constexpr int GAP = 14;
 constexpr int BOARD_PIX = WINDOW_W;
 constexpr int CELL_PIX = (BOARD_PIX - (BOARD_SIZE + 1) * GAP) / BOARD_SIZE;
@@ -36,11 +87,576 @@ enum class Difficulty
     Hard = 3
 };
 
-static mt19937 rng((unsigned)chrono::high_resolution_clock::now().time_since_epoch().count());
+// per thread so AI workers never share generator state
+static thread_local mt19937 rng((unsigned)chrono::high_resolution_clock::now().time_since_epoch().count()
+    ^ (unsigned)hash<thread::id>()(this_thread::get_id()));
+
+// Inline-storage vector for small bounded lists on the move path (no heap)
+template <class T, size_t N>
+struct FixedVector
+{
+    array<T, N> items{};
+    size_t count = 0;
+
+    FixedVector() = default;
+    FixedVector(initializer_list<T> init)
+    {
+        for (const T& v : init)
+            push_back(v);
+    }
+    void push_back(const T& v)
+    {
+        assert(count < N && "FixedVector is full");
+        items[count++] = v;
+    }
+    void clear() { count = 0; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+    T* begin() { return items.data(); }
+    T* end() { return items.data() + count; }
+    const T* begin() const { return items.data(); }
+    const T* end() const { return items.data() + count; }
+};
+
+// ---------------- Tracing ----------------
+// Building with -DTTT_TRACE compiles in timeline tracing; --trace [file] turns
+// it on. Spans go into a ring owned by the recording thread (single producer,
+// no locks); the main loop drains the rings about once a second, and T or
+// exit writes everything so far as Chrome trace-event JSON for Perfetto or
+// chrome://tracing. Without TTT_TRACE the macros below are empty.
+#if defined(TTT_TRACE)
+struct TraceEvent
+{
+    const char* name;    // string literal, or the thread name for 'M'
+    const char* argName; // nullptr for none
+    uint64_t arg;
+    int64_t startNs, durNs;
+    uint32_t tid;
+    char phase; // 'X' span, 'i' instant, 'M' thread name
+};
+
+struct TraceRing
+{
+    static constexpr size_t CAPACITY = 1 << 14;
+    TraceEvent events[CAPACITY];
+    alignas(64) atomic<uint64_t> head{ 0 }; // advanced by the owning thread
+    alignas(64) atomic<uint64_t> tail{ 0 }; // advanced by the collector
+    atomic<uint64_t> dropped{ 0 };
+    atomic<bool> owned{ true };
+    TraceRing* next = nullptr;
+
+    void push(const TraceEvent& e)
+    {
+        uint64_t h = head.load(memory_order_relaxed);
+        if (h - tail.load(memory_order_acquire) >= CAPACITY)
+        {
+            dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        events[h & (CAPACITY - 1)] = e;
+        head.store(h + 1, memory_order_release);
+    }
+};
+
+class Tracer
+{
+public:
+    static constexpr size_t MAX_EVENTS = 1 << 21; // collected; later events are dropped
+
+    atomic<bool> enabled{ false };
+
+    void start()
+    {
+        origin = chrono::steady_clock::now();
+        enabled.store(true, memory_order_release);
+    }
+    int64_t now() const { return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origin).count(); }
+
+    void record(const TraceEvent& e) { ring().push(e); }
+    // label the calling thread's events in the trace
+    void nameThread(const char* name)
+    {
+        if (enabled.load(memory_order_relaxed))
+            record({ name, nullptr, 0, 0, 0, currentTid(), 'M' });
+    }
+    uint32_t currentTid()
+    {
+        ThreadSlot& s = slot();
+        if (!s.tid)
+            s.tid = nextTid.fetch_add(1, memory_order_relaxed);
+        return s.tid;
+    }
+
+    // move finished events out of every ring
+    void collect()
+    {
+        lock_guard<mutex> lock(collectMutex);
+        for (TraceRing* r = rings.load(memory_order_acquire); r; r = r->next)
+        {
+            uint64_t t = r->tail.load(memory_order_relaxed), h = r->head.load(memory_order_acquire);
+            for (; t != h; t++)
+                if (collected.size() < MAX_EVENTS)
+                    collected.push_back(r->events[t & (TraceRing::CAPACITY - 1)]);
+                else
+                    overflow++;
+            r->tail.store(t, memory_order_release);
+        }
+    }
+
+    // at most once a second, from the frame loop
+    void tick()
+    {
+        auto t = chrono::steady_clock::now();
+        if (t - lastCollect >= chrono::seconds(1))
+        {
+            lastCollect = t;
+            collect();
+        }
+    }
+
+    bool write(const string& file)
+    {
+        collect();
+        lock_guard<mutex> lock(collectMutex);
+        ofstream out(file, ios::binary);
+        if (!out)
+        {
+            cerr << "Trace: cannot write " << file << "\n";
+            return false;
+        }
+        out << "{\"traceEvents\":[\n";
+        char buf[256];
+        bool first = true;
+        for (const TraceEvent& e : collected)
+        {
+            int n;
+            if (e.phase == 'M')
+                n = snprintf(buf, sizeof buf, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    e.tid, e.name);
+            else
+            {
+                n = snprintf(buf, sizeof buf, "{\"name\":\"%s\",\"cat\":\"ttt\",\"ph\":\"%c\",\"ts\":%.3f,", e.name, e.phase,
+                    e.startNs / 1000.0);
+                if (e.phase == 'X')
+                    n += snprintf(buf + n, sizeof buf - n, "\"dur\":%.3f,", e.durNs / 1000.0);
+                else
+                    n += snprintf(buf + n, sizeof buf - n, "\"s\":\"t\",");
+                n += snprintf(buf + n, sizeof buf - n, "\"pid\":1,\"tid\":%u", e.tid);
+                if (e.argName)
+                    n += snprintf(buf + n, sizeof buf - n, ",\"args\":{\"%s\":%llu}", e.argName, (unsigned long long)e.arg);
+                n += snprintf(buf + n, sizeof buf - n, "}");
+            }
+            out << (first ? "" : ",\n") << buf;
+            first = false;
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        uint64_t dropped = overflow;
+        for (TraceRing* r = rings.load(memory_order_acquire); r; r = r->next)
+            dropped += r->dropped.load(memory_order_relaxed);
+        cout << "Trace: " << collected.size() << " events written to " << file;
+        if (dropped)
+            cout << " (" << dropped << " dropped)";
+        cout << "\n";
+        return (bool)out;
+    }
+
+private:
+    // the calling thread's ring: a released one if any, else a new one
+    struct ThreadSlot
+    {
+        TraceRing* ring = nullptr;
+        uint32_t tid = 0;
+        ~ThreadSlot()
+        {
+            if (ring)
+                ring->owned.store(false, memory_order_release);
+        }
+    };
+    static ThreadSlot& slot()
+    {
+        static thread_local ThreadSlot s;
+        return s;
+    }
+    TraceRing& ring()
+    {
+        ThreadSlot& s = slot();
+        if (s.ring)
+            return *s.ring;
+        // a finished thread's ring is reused; its unread events keep their tid
+        for (TraceRing* r = rings.load(memory_order_acquire); r; r = r->next)
+        {
+            bool expected = false;
+            if (r->owned.compare_exchange_strong(expected, true, memory_order_acq_rel))
+                return *(s.ring = r);
+        }
+        TraceRing* r = new TraceRing;
+        r->next = rings.load(memory_order_relaxed);
+        while (!rings.compare_exchange_weak(r->next, r, memory_order_release, memory_order_relaxed))
+        {
+        }
+        return *(s.ring = r);
+    }
+
+    chrono::steady_clock::time_point origin, lastCollect;
+    atomic<TraceRing*> rings{ nullptr };
+    atomic<uint32_t> nextTid{ 1 };
+    mutex collectMutex;
+    vector<TraceEvent> collected;
+    uint64_t overflow = 0;
+};
+static Tracer g_trace;
+
+// search nodes visited by this thread; the chooseAIMove span reports the difference
+static thread_local uint64_t t_traceNodes = 0;
+
+// records [construction, destruction) as a span on the calling thread
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name, bool countNodes = false)
+        : name(name), start(g_trace.enabled.load(memory_order_relaxed) ? g_trace.now() : -1), countNodes(countNodes),
+        nodes0(t_traceNodes)
+    {
+    }
+    ~TraceSpan()
+    {
+        if (start < 0)
+            return;
+        if (countNodes)
+            arg("nodes", t_traceNodes - nodes0);
+        g_trace.record({ name, argName, argValue, start, g_trace.now() - start, g_trace.currentTid(), 'X' });
+    }
+    void arg(const char* n, uint64_t v)
+    {
+        argName = n;
+        argValue = v;
+    }
+
+private:
+    const char* name;
+    const char* argName = nullptr;
+    uint64_t argValue = 0;
+    int64_t start;
+    bool countNodes;
+    uint64_t nodes0;
+};
+
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+#define TRACE_SCOPE(name) TraceSpan TRACE_JOIN(traceSpan, __LINE__)(name)
+#define TRACE_SCOPE_NODES(name) TraceSpan TRACE_JOIN(traceSpan, __LINE__)(name, true)
+#define TRACE_INSTANT(name) \
+    (g_trace.enabled.load(memory_order_relaxed) ? g_trace.record({ name, nullptr, 0, g_trace.now(), 0, g_trace.currentTid(), 'i' }) : (void)0)
+#define TRACE_NODES(n) (t_traceNodes += (n))
+#define TRACE_THREAD(name) g_trace.nameThread(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_NODES(name) ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#define TRACE_NODES(n) ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+#endif
+
+// ---------------- Compile-time boards ----------------
+// Board<N, K> is Variant with everything fixed at compile time: the line
+// masks, the lines through each cell and the eight symmetries of the square
+// are constexpr tables. Win checks and cell loops are folds over them, so
+// each instantiation unrolls into immediate-mask tests with no table loads.
+// Cells are row-major: cell i is bit i of a mask. ClassicBoard is the board
+// the classic game is played on.
+constexpr int boardLineCount(int n, int k) { return 2 * n * (n - k + 1) + 2 * (n - k + 1) * (n - k + 1); }
+
+template <int N, int K>
+constexpr array<uint32_t, boardLineCount(N, K)> makeBoardLines()
+{
+    array<uint32_t, boardLineCount(N, K)> lines{};
+    const int dirs[4][2] = { {0, 1}, {1, 0}, {1, 1}, {1, -1} };
+    int count = 0;
+    for (int r = 0; r < N; r++)
+        for (int c = 0; c < N; c++)
+            for (const auto& d : dirs)
+            {
+                int er = r + d[0] * (K - 1), ec = c + d[1] * (K - 1);
+                if (er < 0 || er >= N || ec < 0 || ec >= N)
+                    continue;
+                uint32_t m = 0;
+                for (int s = 0; s < K; s++)
+                    m |= 1u << ((r + d[0] * s) * N + (c + d[1] * s));
+                lines[count++] = m;
+            }
+    return lines;
+}
+
+// most lines through any one cell
+template <int N, int K>
+constexpr int boardMaxCellLines()
+{
+    auto lines = makeBoardLines<N, K>();
+    int most = 0;
+    for (int i = 0; i < N * N; i++)
+    {
+        int n = 0;
+        for (uint32_t m : lines)
+            n += (m >> i) & 1;
+        most = max(most, n);
+    }
+    return most;
+}
+
+template <int N, int K>
+struct BoardCellLines
+{
+    array<array<uint32_t, boardMaxCellLines<N, K>()>, N * N> masks{};
+    array<int, N * N> count{};
+};
+
+template <int N, int K>
+constexpr BoardCellLines<N, K> makeBoardCellLines()
+{
+    BoardCellLines<N, K> t{};
+    for (uint32_t m : makeBoardLines<N, K>())
+        for (int i = 0; i < N * N; i++)
+            if ((m >> i) & 1)
+                t.masks[i][t.count[i]++] = m;
+    return t;
+}
+
+// symmetry s maps cell i to SYMMETRIES[s][i]: bit 0 flips rows, bit 1 flips
+// columns, bit 2 transposes first
+template <int N>
+constexpr array<array<uint8_t, N * N>, 8> makeBoardSymmetries()
+{
+    array<array<uint8_t, N * N>, 8> perms{};
+    for (int s = 0; s < 8; s++)
+        for (int r = 0; r < N; r++)
+            for (int c = 0; c < N; c++)
+            {
+                int rr = (s & 4) ? c : r, cc = (s & 4) ? r : c;
+                if (s & 1)
+                    rr = N - 1 - rr;
+                if (s & 2)
+                    cc = N - 1 - cc;
+                perms[s][r * N + c] = uint8_t(rr * N + cc);
+            }
+    return perms;
+}
+
+template <int N, int K>
+struct Board
+{
+    static_assert(3 <= K && K <= N && N <= 5, "a side's stones must fit a 32-bit mask");
+    using Mask = uint32_t;
+    static constexpr int CELLS = N * N;
+    static constexpr Mask FULL = Mask((1ull << CELLS) - 1);
+    static constexpr int LINE_COUNT = boardLineCount(N, K);
+    static constexpr array<Mask, LINE_COUNT> LINES = makeBoardLines<N, K>();
+    static constexpr BoardCellLines<N, K> CELL_LINES = makeBoardCellLines<N, K>();
+    static constexpr array<array<uint8_t, CELLS>, 8> SYMMETRIES = makeBoardSymmetries<N>();
+
+    static constexpr int idx(int r, int c) { return r * N + c; }
+    static constexpr int rowOf(int i) { return i / N; }
+    static constexpr int colOf(int i) { return i % N; }
+
+    // the cells of a line, in order
+    static FixedVector<int, K> lineCells(Mask line)
+    {
+        FixedVector<int, K> cells;
+        for (int i = 0; i < CELLS; i++)
+            if (line >> i & 1)
+                cells.push_back(i);
+        return cells;
+    }
+
+    static constexpr bool hasLine(Mask stones) { return anyLine(stones, make_index_sequence<LINE_COUNT>()); }
+
+    // true if the stone just placed on Cell completes a line
+    template <int Cell>
+    static constexpr bool completesLine(Mask stones)
+    {
+        return anyCellLine<Cell>(stones, make_index_sequence<CELL_LINES.count[Cell]>());
+    }
+    static constexpr bool completesLine(Mask stones, int cell)
+    {
+        return dispatchCell(stones, cell, make_index_sequence<CELLS>());
+    }
+
+    // f(integral_constant<int, cell>) for each cell in order, unrolled; f
+    // returns false to stop
+    template <class F>
+    static constexpr void forEachCell(F&& f)
+    {
+        eachCell(f, make_index_sequence<CELLS>());
+    }
+
+    template <int S>
+    static constexpr Mask transform(Mask m)
+    {
+        return permute<S>(m, make_index_sequence<CELLS>());
+    }
+
+    // smallest (x, o) pair over the eight symmetries, as one 64-bit key
+    static constexpr uint64_t canonical(Mask x, Mask o)
+    {
+        return canonicalOf(x, o, make_index_sequence<8>());
+    }
+
+    static Mask maskOf(const array<Piece, CELLS>& b, Piece p)
+    {
+        Mask m = 0;
+        forEachCell([&](auto c)
+            {
+                m |= Mask(b[c] == p) << c;
+                return true;
+            });
+        return m;
+    }
+
+private:
+    template <size_t... L>
+    static constexpr bool anyLine(Mask s, index_sequence<L...>)
+    {
+        return (((s & LINES[L]) == LINES[L]) || ...);
+    }
+    template <int Cell, size_t... L>
+    static constexpr bool anyCellLine(Mask s, index_sequence<L...>)
+    {
+        return (((s & CELL_LINES.masks[Cell][L]) == CELL_LINES.masks[Cell][L]) || ...);
+    }
+    template <size_t... C>
+    static constexpr bool dispatchCell(Mask s, int cell, index_sequence<C...>)
+    {
+        return ((cell == int(C) && completesLine<int(C)>(s)) || ...);
+    }
+    template <class F, size_t... C>
+    static constexpr void eachCell(F& f, index_sequence<C...>)
+    {
+        (f(integral_constant<int, int(C)>()) && ...);
+    }
+    template <int S, size_t... C>
+    static constexpr Mask permute(Mask m, index_sequence<C...>)
+    {
+        return ((((m >> C) & 1u) << SYMMETRIES[S][C]) | ...);
+    }
+    template <size_t... S>
+    static constexpr uint64_t canonicalOf(Mask x, Mask o, index_sequence<S...>)
+    {
+        uint64_t best = UINT64_MAX;
+        ((best = min(best, (uint64_t)transform<int(S)>(x) << 32 | transform<int(S)>(o))), ...);
+        return best;
+    }
+};
+
+using ClassicBoard = Board<BOARD_SIZE, WIN_LENGTH>;
+static_assert(ClassicBoard::CELLS == 9, "the server's board strings and Ultimate's sub-boards are nine cells");
+
+// ---------------- Ultimate board ----------------
+// Ultimate tic-tac-toe: nine 3x3 sub-boards laid out as a 3x3 meta-board. A
+// move on cell c of a sub-board sends the opponent to sub-board c (any open
+// one if that is won or full). Each sub-board is a 9-bit mask per side; the
+// meta-board is a mask of won sub-boards per side plus one of closed (won or
+// full) ones. Moves are numbered sub * 9 + cell.
+constexpr uint16_t SUB_LINES[8] = { 0x007, 0x038, 0x1C0, 0x049, 0x092, 0x124, 0x111, 0x054 };
+constexpr uint16_t SUB_FULL = 0x1FF;
+
+// the sub-board lines must be the lines the template generates
+constexpr bool subLinesMatch()
+{
+    if (ClassicBoard::LINE_COUNT != 8)
+        return false;
+    for (uint16_t s : SUB_LINES)
+    {
+        bool generated = false;
+        for (uint32_t g : ClassicBoard::LINES)
+            generated = generated || g == s;
+        if (!generated)
+            return false;
+    }
+    return true;
+}
+static_assert(subLinesMatch(), "SUB_LINES disagree with Board<3, 3>");
+
+// SUB_WIN[m] is 1 if the 9-bit mask m holds a line
+static const array<uint8_t, 512> SUB_WIN = []
+    {
+        array<uint8_t, 512> t{};
+        for (int m = 0; m < 512; m++)
+            for (uint16_t l : SUB_LINES)
+                if ((m & l) == l)
+                    t[m] = 1;
+        return t;
+    }();
+
+struct UltimateBoard
+{
+    uint16_t cells[2][9]{}; // [X, O][sub-board]
+    uint16_t won[2]{};      // sub-boards each side has won
+    uint16_t closed = 0;    // sub-boards with no moves left
+    int8_t forced = -1;     // sub-board the mover must play in, -1 for any
+    uint8_t toMove = 0;     // 0 = X, 1 = O
+    uint8_t plies = 0;
+    int8_t winner = -1;     // 0 = X, 1 = O, 2 = draw, -1 while playing
+    int8_t lastMove = -1;
+
+    void reset(bool xFirst)
+    {
+        *this = UltimateBoard();
+        toMove = xFirst ? 0 : 1;
+    }
+    bool over() const { return winner >= 0; }
+    // mask of the sub-boards the mover may play in
+    uint16_t playable() const
+    {
+        if (over())
+            return 0;
+        if (forced >= 0 && !(closed >> forced & 1))
+            return uint16_t(1u << forced);
+        return uint16_t(SUB_FULL & ~closed);
+    }
+    bool legal(int m) const
+    {
+        if (m < 0 || m >= 81)
+            return false;
+        int sub = m / 9, cell = m % 9;
+        return (playable() >> sub & 1) && !((cells[0][sub] | cells[1][sub]) >> cell & 1);
+    }
+    void play(int m);
+    int generate(uint8_t* out) const; // up to 81 moves
+};
+
+// ---------------- Qubic board ----------------
+// Qubic: 4 x 4 x 4 in a row. Cell layer * 16 + row * 4 + col is one bit of a
+// 64-bit mask per side, and the 76 winning lines are 64-bit masks too.
+struct QubicBoard
+{
+    uint64_t stones[2]{}; // [X, O]
+    uint64_t winLine = 0;
+    uint8_t toMove = 0;   // 0 = X, 1 = O
+    uint8_t plies = 0;
+    int8_t winner = -1;   // 0 = X, 1 = O, 2 = draw, -1 while playing
+    int8_t lastMove = -1;
+
+    void reset(bool xFirst)
+    {
+        *this = QubicBoard();
+        toMove = xFirst ? 0 : 1;
+    }
+    bool over() const { return winner >= 0; }
+    bool legal(int m) const { return !over() && m >= 0 && m < 64 && !((stones[0] | stones[1]) >> m & 1); }
+    void play(int m);
+};
+
+enum class GameMode
+{
+    Classic,
+    Ultimate,
+    Qubic
+};
 
 struct Game
 {
-    array<Piece, 9> board{};
+    array<Piece, ClassicBoard::CELLS> board{};
     string player1Name = "Player 1";
     string player2Name = "Player 2";
     Piece player1Piece = Piece::X;
@@ -49,11 +665,15 @@ struct Game
     bool currentTurnIsAI = false;
     bool finished = false;
     Piece winner = Piece::Empty;
-    vector<int> winLine;
+    FixedVector<int, WIN_LENGTH> winLine;
+    FixedVector<int, ClassicBoard::CELLS> moves; // cells in play order, for game records
     Difficulty difficulty = Difficulty::Medium;
     bool humanVsAI = true;
     bool playerFirst = true;
     bool leaderboardUpdated = false; //ensure we update LB only once per finish
+    GameMode mode = GameMode::Classic; // Ultimate and Qubic play on their own boards
+    UltimateBoard ultimateBoard;
+    QubicBoard qubicBoard;
     Game() { board.fill(Piece::Empty); }
     void reset()
     {
@@ -61,6 +681,7 @@ struct Game
         finished = false;
         winner = Piece::Empty;
         winLine.clear();
+        moves.clear();
         leaderboardUpdated = false;
         // set turnPiece and currentTurnIsAI according to playerFirst and symbol assignment
         if (playerFirst)
@@ -73,28 +694,25 @@ struct Game
             turnPiece = player2Piece;
             currentTurnIsAI = humanVsAI; // if AI goes first and it's vs AI
         }
+        ultimateBoard.reset(turnPiece == Piece::X);
+        qubicBoard.reset(turnPiece == Piece::X);
     }
 };
 
-// board helpers
-inline int idx(int r, int c) { return r * BOARD_SIZE + c; }
-inline int rowOf(int i) { return i / BOARD_SIZE; }
-inline int colOf(int i) { return i % BOARD_SIZE; }
-static const int LINES[8][3] = {
-    {0, 1, 2}, {3, 4, 5}, {6, 7, 8}, {0, 3, 6}, {1, 4, 7}, {2, 5, 8}, {0, 4, 8}, {2, 4, 6} };
-bool isBoardFull(const array<Piece, 9>& b)
+// board helpers; the geometry is ClassicBoard's
+bool isBoardFull(const array<Piece, ClassicBoard::CELLS>& b)
 {
-    for (auto& p : b)
-        if (p == Piece::Empty)
-            return false;
-    return true;
+    return ClassicBoard::maskOf(b, Piece::Empty) == 0;
 }
-vector<int> emptyIndices(const array<Piece, 9>& b)
+FixedVector<int, ClassicBoard::CELLS> emptyIndices(const array<Piece, ClassicBoard::CELLS>& b)
 {
-    vector<int> r;
-    for (int i = 0; i < 9; i++)
-        if (b[i] == Piece::Empty)
-            r.push_back(i);
+    FixedVector<int, ClassicBoard::CELLS> r;
+    ClassicBoard::forEachCell([&](auto c)
+        {
+            if (b[c] == Piece::Empty)
+                r.push_back(c);
+            return true;
+        });
     return r;
 }
 
@@ -103,18 +721,17 @@ void checkFinish(Game& g)
     g.finished = false;
     g.winner = Piece::Empty;
     g.winLine.clear();
-    for (auto& line : LINES)
+    for (Piece p : { Piece::X, Piece::O })
     {
-        Piece a = g.board[line[0]];
-        if (a == Piece::Empty)
-            continue;
-        if (a == g.board[line[1]] && a == g.board[line[2]])
-        {
-            g.finished = true;
-            g.winner = a;
-            g.winLine = { line[0], line[1], line[2] };
-            return;
-        }
+        ClassicBoard::Mask stones = ClassicBoard::maskOf(g.board, p);
+        for (ClassicBoard::Mask line : ClassicBoard::LINES)
+            if ((stones & line) == line)
+            {
+                g.finished = true;
+                g.winner = p;
+                g.winLine = ClassicBoard::lineCells(line);
+                return;
+            }
     }
     if (isBoardFull(g.board))
     {
@@ -123,727 +740,6236 @@ void checkFinish(Game& g)
     }
 }
 
-// ---------------- AI ----------------
-int easyAIMove(const Game& g)
-{
-    auto e = emptyIndices(g.board);
-    if (e.empty())
-        return -1;
-    uniform_int_distribution<int> d(0, (int)e.size() - 1);
-    return e[d(rng)];
-}
-
-int evaluateBoard(const array<Piece, 9>& b, Piece aiPiece)
+// place the active piece on cell m and pass the turn if the game goes on
+void applyMove(Game& g, int m)
 {
-    for (auto& line : LINES)
+    if (g.mode != GameMode::Classic)
     {
-        Piece a = b[line[0]];
-        if (a == Piece::Empty)
-            continue;
-        if (a == b[line[1]] && a == b[line[2]])
-            return (a == aiPiece) ? 10 : -10;
+        // m is sub * 9 + cell (Ultimate) or a cube cell (Qubic); those boards
+        // keep their own history
+        int winner;
+        if (g.mode == GameMode::Ultimate)
+        {
+            g.ultimateBoard.play(m);
+            winner = g.ultimateBoard.winner;
+        }
+        else
+        {
+            g.qubicBoard.play(m);
+            winner = g.qubicBoard.winner;
+        }
+        g.finished = winner >= 0;
+        g.winner = winner == 0 ? Piece::X : winner == 1 ? Piece::O : Piece::Empty;
     }
-    return 0;
-}
-
-int minimax(array<Piece, 9>& b, bool maxing, int alpha, int beta, Piece aiPiece)
-{
-    Piece humanPiece = (aiPiece == Piece::X) ? Piece::O : Piece::X;
-    int score = evaluateBoard(b, aiPiece);
-    if (score == 10 || score == -10)
-        return score;
-    if (isBoardFull(b))
-        return 0;
-    if (maxing)
+    else
     {
-        int best = -10000;
-        for (int i = 0; i < 9; ++i)
-            if (b[i] == Piece::Empty)
-            {
-                b[i] = aiPiece;
-                best = max(best, minimax(b, false, alpha, beta, aiPiece));
-                b[i] = Piece::Empty;
-                alpha = max(alpha, best);
-                if (beta <= alpha)
-                    break;
-            }
-        return best;
+        g.board[m] = g.turnPiece;
+        g.moves.push_back(m);
+        checkFinish(g);
     }
-    else
+    if (!g.finished)
     {
-        int best = 10000;
-        for (int i = 0; i < 9; ++i)
-            if (b[i] == Piece::Empty)
-            {
-                b[i] = humanPiece;
-                best = min(best, minimax(b, true, alpha, beta, aiPiece));
-                b[i] = Piece::Empty;
-                beta = min(beta, best);
-                if (beta <= alpha)
-                    break;
-            }
-        return best;
+        g.turnPiece = (g.turnPiece == g.player1Piece) ? g.player2Piece : g.player1Piece;
+        g.currentTurnIsAI = (g.humanVsAI && g.turnPiece == g.player2Piece);
     }
 }
 
-int hardAIMove(Game& g)
+// ---------------- Compact game state ----------------
+// GameState is the server's per-session record; the window, the tools and
+// the AI keep playing on Game. applyMove(GameState&) below is applyMove(Game&)
+// redone on masks, and --bench-state checks the two agree game for game.
+//
+// Player names are interned and reference counted: intern() takes a
+// reference, release() drops it, and an id whose last reference goes is
+// reused for the next new name, so a long-running server holds only the
+// names of its live sessions.
+class NameTable
 {
-    Piece aiPiece = g.player2Piece; // AI always assigned to player2
-    int bestVal = -10000, bestIdx = -1;
-    for (int i = 0; i < 9; ++i)
-        if (g.board[i] == Piece::Empty)
+public:
+    uint32_t intern(const string& name)
+    {
+        lock_guard<mutex> lk(lock);
+        auto it = ids.find(name);
+        if (it != ids.end())
         {
-            g.board[i] = aiPiece;
-            int val = minimax(g.board, false, -10000, 10000, aiPiece);
-            g.board[i] = Piece::Empty;
-            if (val > bestVal)
-            {
-                bestVal = val;
-                bestIdx = i;
-            }
+            entries[it->second].refs++;
+            return it->second;
         }
-    if (bestIdx == -1)
+        uint32_t id;
+        if (!freeIds.empty())
+        {
+            id = freeIds.back();
+            freeIds.pop_back();
+        }
+        else
+        {
+            id = (uint32_t)entries.size();
+            entries.emplace_back();
+        }
+        entries[id] = { name, 1 };
+        return ids[name] = id;
+    }
+    void release(uint32_t id)
     {
-        auto e = emptyIndices(g.board);
-        if (e.empty())
-            return -1;
-        uniform_int_distribution<int> d(0, (int)e.size() - 1);
-        return e[d(rng)];
+        lock_guard<mutex> lk(lock);
+        Entry& e = entries[id];
+        if (e.refs == 0 || --e.refs > 0)
+            return;
+        ids.erase(e.name);
+        e.name = string();
+        freeIds.push_back(id);
     }
+    // a copy, since the id may be released and reused meanwhile
+    string name(uint32_t id) const
+    {
+        lock_guard<mutex> lk(lock);
+        return entries[id].name;
+    }
+    size_t live() const
+    {
+        lock_guard<mutex> lk(lock);
+        return ids.size();
+    }
+
+private:
+    struct Entry
+    {
+        string name;
+        uint32_t refs = 0;
+    };
+    mutable mutex lock;
+    map<string, uint32_t> ids;
+    deque<Entry> entries;
+    vector<uint32_t> freeIds;
+};
+
+static NameTable g_names;
+
+// Everything a session needs between moves, in 12 trivially-copyable bytes:
+// one bit per cell per symbol, the flags of Game and two interned names
+// (the owner of the state releases them).
+// Flat arrays of these can be scanned, snapshotted and memcpy'd directly.
+struct GameState
+{
+    uint32_t xMask : 9;
+    uint32_t oMask : 9;
+    uint32_t player1IsX : 1;
+    uint32_t turnIsX : 1;
+    uint32_t currentTurnIsAI : 1;
+    uint32_t finished : 1;
+    uint32_t winner : 2; // Piece value
+    uint32_t difficulty : 2; // Difficulty value
+    uint32_t humanVsAI : 1;
+    uint32_t playerFirst : 1;
+    uint32_t leaderboardUpdated : 1;
+    uint32_t player1 = 0, player2 = 0; // g_names ids
+    GameState()
+        : xMask(0), oMask(0), player1IsX(1), turnIsX(1), currentTurnIsAI(0), finished(0), winner(0),
+        difficulty((uint32_t)Difficulty::Medium), humanVsAI(1), playerFirst(1), leaderboardUpdated(0)
+    {
+    }
+};
+static_assert(is_trivially_copyable<GameState>::value, "GameState must stay memcpy-able");
+static_assert(sizeof(GameState) == 12, "GameState grew");
+
+inline Piece pieceAt(const GameState& s, int i)
+{
+    return (s.xMask >> i & 1) ? Piece::X : (s.oMask >> i & 1) ? Piece::O : Piece::Empty;
+}
+inline Piece player1PieceOf(const GameState& s) { return s.player1IsX ? Piece::X : Piece::O; }
+inline Piece player2PieceOf(const GameState& s) { return s.player1IsX ? Piece::O : Piece::X; }
+
+array<Piece, ClassicBoard::CELLS> boardOf(const GameState& s)
+{
+    array<Piece, ClassicBoard::CELLS> b;
+    for (int i = 0; i < ClassicBoard::CELLS; i++)
+        b[i] = pieceAt(s, i);
+    return b;
+}
+
+// mask of the winning line, 0 if none
+ClassicBoard::Mask winLineOf(const GameState& s)
+{
+    ClassicBoard::Mask stones = (s.winner == (uint32_t)Piece::X) ? s.xMask : (s.winner == (uint32_t)Piece::O) ? s.oMask : 0;
+    for (ClassicBoard::Mask line : ClassicBoard::LINES)
+        if ((stones & line) == line)
+            return line;
+    return 0;
+}
+
+// same rules as Game::reset
+void resetState(GameState& s)
+{
+    s.xMask = s.oMask = 0;
+    s.finished = 0;
+    s.winner = (uint32_t)Piece::Empty;
+    s.leaderboardUpdated = 0;
+    Piece first = s.playerFirst ? player1PieceOf(s) : player2PieceOf(s);
+    s.turnIsX = first == Piece::X;
+    s.currentTurnIsAI = !s.playerFirst && s.humanVsAI;
+}
+
+// applyMove + checkFinish on the packed form
+void applyMove(GameState& s, int m)
+{
+    bool x = s.turnIsX;
+    uint32_t mine = (x ? s.xMask : s.oMask) | (1u << m);
+    if (x)
+        s.xMask = mine;
+    else
+        s.oMask = mine;
+    for (ClassicBoard::Mask line : ClassicBoard::LINES)
+        if ((mine & line) == line)
+        {
+            s.finished = 1;
+            s.winner = (uint32_t)(x ? Piece::X : Piece::O);
+            return;
+        }
+    if ((s.xMask | s.oMask) == ClassicBoard::FULL)
+    {
+        s.finished = 1;
+        s.winner = (uint32_t)Piece::Empty;
+        return;
+    }
+    s.turnIsX = !x;
+    s.currentTurnIsAI = s.humanVsAI && (s.turnIsX ? Piece::X : Piece::O) == player2PieceOf(s);
+}
+
+// takes a reference on both player names
+GameState packGame(const Game& g)
+{
+    GameState s;
+    for (int i = 0; i < ClassicBoard::CELLS; i++)
+    {
+        if (g.board[i] == Piece::X)
+            s.xMask |= 1u << i;
+        else if (g.board[i] == Piece::O)
+            s.oMask |= 1u << i;
+    }
+    s.player1IsX = g.player1Piece == Piece::X;
+    s.turnIsX = g.turnPiece == Piece::X;
+    s.currentTurnIsAI = g.currentTurnIsAI;
+    s.finished = g.finished;
+    s.winner = (uint32_t)g.winner;
+    s.difficulty = (uint32_t)g.difficulty;
+    s.humanVsAI = g.humanVsAI;
+    s.playerFirst = g.playerFirst;
+    s.leaderboardUpdated = g.leaderboardUpdated;
+    s.player1 = g_names.intern(g.player1Name);
+    s.player2 = g_names.intern(g.player2Name);
+    return s;
+}
+
+void unpackGame(const GameState& s, Game& g)
+{
+    g.board = boardOf(s);
+    g.player1Name = g_names.name(s.player1);
+    g.player2Name = g_names.name(s.player2);
+    g.player1Piece = player1PieceOf(s);
+    g.player2Piece = player2PieceOf(s);
+    g.turnPiece = s.turnIsX ? Piece::X : Piece::O;
+    g.currentTurnIsAI = s.currentTurnIsAI;
+    g.finished = s.finished;
+    g.winner = (Piece)s.winner;
+    g.winLine.clear();
+    ClassicBoard::Mask line = winLineOf(s);
+    if (line)
+        g.winLine = ClassicBoard::lineCells(line);
+    g.difficulty = (Difficulty)s.difficulty;
+    g.humanVsAI = s.humanVsAI;
+    g.playerFirst = s.playerFirst;
+    g.leaderboardUpdated = s.leaderboardUpdated;
+}
+
+// ---------------- Bit helpers ----------------
+inline int popCount32(uint32_t x)
+{
+#if defined(_MSC_VER)
+    return (int)__popcnt(x);
+#else
+    return __builtin_popcount(x);
+#endif
+}
+inline int lowestBit32(uint32_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+inline int popCount64(uint64_t x)
+{
+#if defined(_MSC_VER)
+    return (int)__popcnt64(x);
+#else
+    return __builtin_popcountll(x);
+#endif
+}
+
+inline int lowestBit64(uint64_t x)
+{
+#if defined(__BMI__)
+    return (int)_tzcnt_u64(x);
+#elif defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+inline uint64_t clearLowestBit64(uint64_t x)
+{
+#if defined(__BMI__)
+    return _blsr_u64(x);
+#else
+    return x & (x - 1);
+#endif
+}
+
+inline int countLeadingZeros64(uint64_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    return _BitScanReverse64(&i, x) ? 63 - (int)i : 64;
+#else
+    return x ? __builtin_clzll(x) : 64;
+#endif
+}
+
+// ---------------- Board variants (N x N, K in a row) ----------------
+// Cell i of an N x N board is bit i of a mask (row-major, as in Board<N, K>).
+struct Variant
+{
+    int n = 3, k = 3, cells = 9;
+    vector<uint32_t> lines;             // one mask per winning line
+    vector<vector<uint32_t>> cellLines; // winning lines through each cell
+};
+
+Variant makeVariant(int n, int k)
+{
+    Variant v;
+    v.n = n;
+    v.k = k;
+    v.cells = n * n;
+    const int dirs[4][2] = { {0, 1}, {1, 0}, {1, 1}, {1, -1} };
+    for (int r = 0; r < n; r++)
+        for (int c = 0; c < n; c++)
+            for (auto& d : dirs)
+            {
+                int er = r + d[0] * (k - 1), ec = c + d[1] * (k - 1);
+                if (er < 0 || er >= n || ec < 0 || ec >= n)
+                    continue;
+                uint32_t m = 0;
+                for (int s = 0; s < k; s++)
+                    m |= 1u << ((r + d[0] * s) * n + (c + d[1] * s));
+                v.lines.push_back(m);
+            }
+    v.cellLines.resize(v.cells);
+    for (uint32_t m : v.lines)
+        for (int i = 0; i < v.cells; i++)
+            if (m & (1u << i))
+                v.cellLines[i].push_back(m);
+    return v;
+}
+
+inline bool hasLine(const Variant& v, uint32_t stones)
+{
+    for (uint32_t m : v.lines)
+        if ((stones & m) == m)
+            return true;
+    return false;
+}
+
+// true if the stone just placed on `cell` completes a line
+inline bool completesLine(const Variant& v, uint32_t stones, int cell)
+{
+    for (uint32_t m : v.cellLines[cell])
+        if ((stones & m) == m)
+            return true;
+    return false;
+}
+
+// ---------------- Endgame database ----------------
+// Positions are stored relative to the side to move: `mine` holds the stones of
+// the player about to move and `theirs` the opponent's, so one table serves
+// both symbols and either first mover. The mover has either as many stones as
+// the opponent (they moved first) or one fewer.
+//
+// Index = layerOffset(m, t) + rank(theirs) * C(cells - t, m) + rank(mine among
+// the free cells), ranks being colex combination ranks. That is a perfect hash
+// over every stone-count-legal position, one byte per entry.
+//
+// Entry byte: top two bits = result for the side to move, low six bits = plies
+// until the game ends with best play.
+enum EgResult : uint8_t
+{
+    EG_UNKNOWN = 0,
+    EG_LOSS = 1,
+    EG_DRAW = 2,
+    EG_WIN = 3
+};
+inline uint8_t egPack(int result, int dist) { return uint8_t((result << 6) | min(dist, 63)); }
+inline int egResult(uint8_t e) { return e >> 6; }
+inline int egDistance(uint8_t e) { return e & 63; }
+
+// higher is better for the side choosing the move
+inline int egScore(uint8_t e)
+{
+    int d = egDistance(e);
+    switch (egResult(e))
+    {
+    case EG_WIN:
+        return 1000 - d;
+    case EG_LOSS:
+        return -1000 + d;
+    default:
+        return 0;
+    }
+}
+
+constexpr uint64_t EG_MAX_ENTRIES = 1ull << 32;
+
+struct PositionIndexer
+{
+    int cells = 0;
+    uint64_t binom[33][33]{};
+    uint64_t offsets[33][2]{}; // [m][t - m]
+    uint64_t total = 0;
+
+    explicit PositionIndexer(int c = 9) : cells(c)
+    {
+        for (int i = 0; i <= 32; i++)
+        {
+            binom[i][0] = 1;
+            for (int j = 1; j <= i; j++)
+                binom[i][j] = binom[i - 1][j - 1] + (j < i ? binom[i - 1][j] : 0);
+        }
+        for (int m = 0; 2 * m <= cells; m++)
+            for (int dt = 0; dt < 2; dt++)
+            {
+                int t = m + dt;
+                offsets[m][dt] = total;
+                if (m + t <= cells)
+                    total += layerSize(m, t);
+            }
+    }
+    uint64_t layerSize(int m, int t) const { return binom[cells][t] * binom[cells - t][m]; }
+    uint64_t index(uint32_t mine, uint32_t theirs) const
+    {
+        int m = popCount32(mine), t = popCount32(theirs);
+        uint64_t rt = 0, rm = 0;
+        int j = 1;
+        for (uint32_t s = theirs; s; s &= s - 1)
+            rt += binom[lowestBit32(s)][j++];
+        j = 1;
+        for (uint32_t s = mine; s; s &= s - 1)
+        {
+            int p = lowestBit32(s);
+            rm += binom[p - popCount32(theirs & ((1u << p) - 1))][j++];
+        }
+        return offsets[m][t - m] + rt * binom[cells - t][m] + rm;
+    }
+};
+
+// next combination with the same popcount in colex order (Gosper's hack)
+inline uint32_t nextCombination(uint32_t x)
+{
+    uint32_t c = x & (0u - x), r = x + c;
+    return (((r ^ x) >> 2) / c) | r;
+}
+
+struct EndgameHeader
+{
+    char magic[8] = { 'T', 'T', 'T', 'E', 'G', 'D', 'B', '1' };
+    uint32_t n = 0, k = 0;
+    uint64_t entries = 0;
+};
+
+// Solves every position of the variant by retrograde analysis: layers are
+// processed from the full board backwards, each one only reading the layer
+// with one more stone. Work inside a layer is split across threads.
+bool generateEndgameTable(const Variant& v, const string& filename, int threads)
+{
+    PositionIndexer ix(v.cells);
+    if (v.cells > 25 || ix.total >= EG_MAX_ENTRIES)
+    {
+        cerr << "Endgame table for " << v.n << "x" << v.n << " would need " << ix.total << " entries; too large\n";
+        return false;
+    }
+    vector<uint8_t> table(ix.total, EG_UNKNOWN);
+    auto start = chrono::steady_clock::now();
+
+    for (int stones = v.cells; stones >= 0; stones--)
+    {
+        // exactly one stone-count layer per total: the opponent has the odd stone
+        int m = stones / 2, t = stones - m;
+        vector<uint32_t> theirsSets;
+        uint32_t limit = 1u << v.cells;
+        for (uint32_t x = (1u << t) - 1; x < limit; x = t ? nextCombination(x) : limit)
+            theirsSets.push_back(x);
+
+        atomic<size_t> next{ 0 };
+        auto worker = [&]()
+            {
+                int freeCells[32];
+                size_t i;
+                while ((i = next.fetch_add(1)) < theirsSets.size())
+                {
+                    uint32_t theirs = theirsSets[i];
+                    int nFree = 0;
+                    for (int c = 0; c < v.cells; c++)
+                        if (!(theirs & (1u << c)))
+                            freeCells[nFree++] = c;
+                    uint64_t base = ix.offsets[m][t - m] + i * ix.binom[nFree][m];
+                    bool theirsWon = hasLine(v, theirs);
+                    uint32_t freeLimit = 1u << nFree, rank = 0;
+                    for (uint32_t sel = (1u << m) - 1; sel < freeLimit; sel = m ? nextCombination(sel) : freeLimit, rank++)
+                    {
+                        uint32_t mine = 0;
+                        for (uint32_t s = sel; s; s &= s - 1)
+                            mine |= 1u << freeCells[lowestBit32(s)];
+                        uint8_t& out = table[base + rank];
+                        if (theirsWon)
+                        {
+                            out = egPack(EG_LOSS, 0);
+                            continue;
+                        }
+                        if (stones == v.cells)
+                        {
+                            out = egPack(EG_DRAW, 0);
+                            continue;
+                        }
+                        int best = INT32_MIN;
+                        uint8_t bestEntry = EG_UNKNOWN;
+                        uint32_t empty = ~(mine | theirs) & (limit - 1);
+                        for (uint32_t e = empty; e; e &= e - 1)
+                        {
+                            int c = lowestBit32(e);
+                            uint8_t child = table[ix.index(theirs, mine | (1u << c))];
+                            int d = egDistance(child) + 1;
+                            uint8_t mineEntry = egResult(child) == EG_LOSS ? egPack(EG_WIN, d)
+                                : egResult(child) == EG_WIN ? egPack(EG_LOSS, d)
+                                : egPack(EG_DRAW, d);
+                            if (egScore(mineEntry) > best)
+                            {
+                                best = egScore(mineEntry);
+                                bestEntry = mineEntry;
+                            }
+                        }
+                        out = bestEntry;
+                    }
+                }
+            };
+        vector<thread> pool;
+        for (int w = 1; w < threads; w++)
+            pool.emplace_back(worker);
+        worker();
+        for (auto& th : pool)
+            th.join();
+    }
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    ofstream out(filename, ios::binary | ios::trunc);
+    if (!out.is_open())
+    {
+        cerr << "Cannot write " << filename << "\n";
+        return false;
+    }
+    EndgameHeader h;
+    h.n = (uint32_t)v.n;
+    h.k = (uint32_t)v.k;
+    h.entries = ix.total;
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    out.write(reinterpret_cast<const char*>(table.data()), (streamsize)table.size());
+    if (!out)
+    {
+        cerr << "Failed writing " << filename << "\n";
+        return false;
+    }
+    uint8_t root = table[ix.index(0, 0)];
+    const char* rootName[] = { "?", "second player wins", "draw", "first player wins" };
+    cout << "Solved " << v.n << "x" << v.n << " (k=" << v.k << "): " << ix.total << " positions in " << fixed << setprecision(2)
+        << secs << "s on " << threads << " threads; " << rootName[egResult(root)] << " in " << egDistance(root) << " plies\n";
+    return true;
+}
+
+// Read-only view of a generated table. The file is memory-mapped so every game
+// process probing the same table shares one copy of its pages.
+class EndgameTable
+{
+public:
+    EndgameTable() = default;
+    EndgameTable(const EndgameTable&) = delete;
+    EndgameTable& operator=(const EndgameTable&) = delete;
+    ~EndgameTable() { close(); }
+
+    bool open(const string& filename)
+    {
+        close();
+        size_t size = 0;
+#if defined(_WIN32)
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER li;
+        if (!GetFileSizeEx(file, &li) || !(mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr)))
+        {
+            close();
+            return false;
+        }
+        size = (size_t)li.QuadPart;
+        base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            size = (size_t)st.st_size;
+            void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            base = (p == MAP_FAILED) ? nullptr : p;
+        }
+        ::close(fd);
+#endif
+        mappedSize = size;
+        if (!base || size < sizeof(EndgameHeader))
+        {
+            close();
+            return false;
+        }
+        EndgameHeader expect, h;
+        memcpy(&h, base, sizeof(h));
+        if (memcmp(h.magic, expect.magic, sizeof(h.magic)) != 0 || h.n < 3 || h.n > 5)
+        {
+            close();
+            return false;
+        }
+        ix = PositionIndexer((int)(h.n * h.n));
+        if (h.entries != ix.total || size < sizeof(h) + h.entries)
+        {
+            close();
+            return false;
+        }
+        n = (int)h.n;
+        k = (int)h.k;
+        entries = static_cast<const uint8_t*>(base) + sizeof(h);
+        return true;
+    }
+
+    void close()
+    {
+#if defined(_WIN32)
+        if (base)
+            UnmapViewOfFile(base);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base)
+            munmap(base, mappedSize);
+#endif
+        base = nullptr;
+        entries = nullptr;
+        mappedSize = 0;
+        n = k = 0;
+    }
+
+    bool covers(int boardN, int winK) const { return entries && n == boardN && k == winK; }
+    uint8_t probe(uint32_t mine, uint32_t theirs) const { return entries[ix.index(mine, theirs)]; }
+
+private:
+    void* base = nullptr;
+    size_t mappedSize = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+    const uint8_t* entries = nullptr;
+    PositionIndexer ix;
+    int n = 0, k = 0;
+};
+
+static EndgameTable g_endgame;
+
+string endgameFileName(int n, int k)
+{
+    return "endgame_" + to_string(n) + "x" + to_string(n) + "k" + to_string(k) + ".tttdb";
+}
+
+// Best move for `mover` straight from the table, or -1 if no table covers the board.
+int endgameBestMove(const array<Piece, ClassicBoard::CELLS>& b, Piece mover)
+{
+    if (!g_endgame.covers(BOARD_SIZE, WIN_LENGTH))
+        return -1;
+    uint32_t mine = 0, theirs = 0;
+    for (int i = 0; i < ClassicBoard::CELLS; i++)
+        if (b[i] == mover)
+            mine |= 1u << i;
+        else if (b[i] != Piece::Empty)
+            theirs |= 1u << i;
+    int best = INT32_MIN, bestIdx = -1;
+    for (int i = 0; i < ClassicBoard::CELLS; i++)
+        if (b[i] == Piece::Empty)
+        {
+            // the child is scored from the opponent's side
+            int score = -egScore(g_endgame.probe(theirs, mine | (1u << i)));
+            if (score > best)
+            {
+                best = score;
+                bestIdx = i;
+            }
+        }
     return bestIdx;
 }
 
-int mediumAIMove(Game& g)
+// ---------------- Transposition table ----------------
+// One table shared by every search thread. Positions are keyed by a Zobrist
+// hash that make/unmake keep up to date by XOR. A bucket is one cache line of
+// four entries; each entry is two 64-bit words written without locks, the key
+// stored XORed with the data, so a reader that sees halves of two different
+// writes fails verification and treats the slot as a miss.
+struct Zobrist
+{
+    uint64_t keys[2][64]; // [X, O][cell]
+    uint64_t sideKey;     // in the hash while O is to move, where stones alone don't say
+
+    Zobrist()
+    {
+        // splitmix64 from a fixed seed, so hashes are the same on every run
+        uint64_t s = 0x2545F4914F6CDD1Dull;
+        for (auto& side : keys)
+            for (auto& k : side)
+            {
+                uint64_t z = (s += 0x9E3779B97F4A7C15ull);
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                k = z ^ (z >> 31);
+            }
+        uint64_t z = (s += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        sideKey = z ^ (z >> 31);
+    }
+};
+static const Zobrist ZOBRIST;
+
+enum TTBound : uint8_t
+{
+    TT_NONE = 0,
+    TT_UPPER = 1, // score <= stored
+    TT_LOWER = 2, // score >= stored
+    TT_EXACT = 3
+};
+
+struct TTEntry
+{
+    int score = 0;
+    int depth = 0; // empty cells below the position
+    TTBound bound = TT_NONE;
+    int move = -1;
+};
+
+// per-thread, summed after the search so the hot path never shares a counter
+struct TTStats
+{
+    uint64_t probes = 0, hits = 0, collisions = 0, stores = 0, overwrites = 0;
+    TTStats& operator+=(const TTStats& o)
+    {
+        probes += o.probes;
+        hits += o.hits;
+        collisions += o.collisions;
+        stores += o.stores;
+        overwrites += o.overwrites;
+        return *this;
+    }
+};
+
+class TranspositionTable
+{
+public:
+    explicit TranspositionTable(size_t megabytes) { resize(megabytes); }
+
+    // largest power-of-two bucket count that fits the budget
+    void resize(size_t megabytes)
+    {
+        size_t want = max<size_t>(1, (megabytes << 20) / sizeof(Bucket));
+        size_t n = 1;
+        while (n * 2 <= want)
+            n *= 2;
+        buckets.reset(new Bucket[n]);
+        mask = n - 1;
+    }
+
+    size_t bytes() const { return (mask + 1) * sizeof(Bucket); }
+
+    bool probe(uint64_t hash, TTEntry& out, TTStats& st) const
+    {
+        st.probes++;
+        const Bucket& b = buckets[hash & mask];
+        bool occupied = false;
+        for (const Slot& s : b.slots)
+        {
+            uint64_t data = s.data.load(memory_order_relaxed);
+            uint64_t key = s.key.load(memory_order_relaxed);
+            if (data == 0)
+                continue;
+            if ((key ^ data) == hash)
+            {
+                out = unpack(data);
+                st.hits++;
+                return true;
+            }
+            occupied = true;
+        }
+        if (occupied)
+            st.collisions++; // other positions share the bucket
+        return false;
+    }
+
+    // depth-preferred: a position's own entry is refreshed, otherwise the
+    // shallowest slot goes, and only to an entry at least as deep
+    void store(uint64_t hash, const TTEntry& e, TTStats& st)
+    {
+        Bucket& b = buckets[hash & mask];
+        Slot* victim = nullptr;
+        int victimDepth = INT32_MAX;
+        bool same = false;
+        for (Slot& s : b.slots)
+        {
+            uint64_t data = s.data.load(memory_order_relaxed);
+            uint64_t key = s.key.load(memory_order_relaxed);
+            if (data != 0 && (key ^ data) == hash)
+            {
+                victim = &s;
+                victimDepth = depthOf(data);
+                same = true;
+                break;
+            }
+            int d = data == 0 ? -1 : depthOf(data);
+            if (d < victimDepth)
+            {
+                victim = &s;
+                victimDepth = d;
+            }
+        }
+        if (victimDepth > e.depth)
+            return;
+        if (!same && victimDepth >= 0)
+            st.overwrites++;
+        st.stores++;
+        uint64_t data = pack(e);
+        victim->key.store(hash ^ data, memory_order_relaxed);
+        victim->data.store(data, memory_order_relaxed);
+    }
+
+private:
+    struct Slot
+    {
+        atomic<uint64_t> key{ 0 }, data{ 0 };
+    };
+    struct alignas(64) Bucket
+    {
+        Slot slots[4];
+    };
+    static_assert(sizeof(Bucket) == 64, "a bucket should fill one cache line");
+
+    // score:16 | depth:8 | bound:2 | move+1:8; a stored bound is never TT_NONE,
+    // so live data is never zero
+    static uint64_t pack(const TTEntry& e)
+    {
+        return uint64_t(uint16_t(e.score + 32768)) | uint64_t(e.depth & 0xFF) << 16 | uint64_t(e.bound) << 24
+            | uint64_t((e.move + 1) & 0xFF) << 26;
+    }
+    static TTEntry unpack(uint64_t d)
+    {
+        TTEntry e;
+        e.score = int(d & 0xFFFF) - 32768;
+        e.depth = int(d >> 16 & 0xFF);
+        e.bound = TTBound(d >> 24 & 3);
+        e.move = int(d >> 26 & 0xFF) - 1;
+        return e;
+    }
+    static int depthOf(uint64_t d) { return int(d >> 16 & 0xFF); }
+
+    unique_ptr<Bucket[]> buckets;
+    size_t mask = 0;
+};
+
+// Alpha-beta solver for a Variant board. Scores are for the side to move:
+// 1000 - plies to a win, -(1000 - plies) to a loss, 0 for a draw, with plies
+// counted from the search root. Table entries hold them relative to their own
+// node so a transposition reached at another ply can reuse them.
+class TTSearch
+{
+public:
+    static constexpr int WIN = 1000, INF = 10000;
+
+    TTSearch(const Variant& v, TranspositionTable* tt) : v(v), tt(tt), full((1u << v.cells) - 1)
+    {
+        // cells on more lines are tried first
+        for (int i = 0; i < v.cells; i++)
+            order[i] = i;
+        stable_sort(order, order + v.cells, [&](int a, int b) { return v.cellLines[a].size() > v.cellLines[b].size(); });
+    }
+
+    // X/O masks, X to move when the counts are equal
+    void setPosition(uint32_t x, uint32_t o)
+    {
+        stones[0] = x;
+        stones[1] = o;
+        side = popCount32(x) == popCount32(o) ? 0 : 1;
+        ply = 0;
+        hash = 0;
+        for (int i = 0; i < v.cells; i++)
+            if (x >> i & 1)
+                hash ^= ZOBRIST.keys[0][i];
+            else if (o >> i & 1)
+                hash ^= ZOBRIST.keys[1][i];
+    }
+
+    void make(int cell)
+    {
+        stones[side] |= 1u << cell;
+        hash ^= ZOBRIST.keys[side][cell];
+        side ^= 1;
+        ply++;
+    }
+
+    void unmake(int cell)
+    {
+        side ^= 1;
+        stones[side] &= ~(1u << cell);
+        hash ^= ZOBRIST.keys[side][cell];
+        ply--;
+    }
+
+    bool moverWinsWith(int cell) const { return completesLine(v, stones[side] | (1u << cell), cell); }
+    uint32_t occupied() const { return stones[0] | stones[1]; }
+
+    int search(int alpha, int beta)
+    {
+        nodes++;
+        // the endgame table is exact and, like the TT, scores from this node
+        if (endgame)
+        {
+            uint8_t eg = endgame->probe(stones[side], stones[side ^ 1]);
+            if (egResult(eg) != EG_UNKNOWN)
+                return fromTable(egScore(eg));
+        }
+        uint32_t occ = occupied();
+        int depth = v.cells - popCount32(occ);
+        // a win on the spot beats anything the table could say
+        for (uint32_t e = full & ~occ; e; e &= e - 1)
+            if (moverWinsWith(lowestBit32(e)))
+                return WIN - (ply + 1);
+
+        int ttMove = -1;
+        TTEntry e;
+        if (tt && tt->probe(hash, e, stats))
+        {
+            int s = fromTable(e.score);
+            if (e.depth >= depth
+                && (e.bound == TT_EXACT || (e.bound == TT_LOWER && s >= beta) || (e.bound == TT_UPPER && s <= alpha)))
+                return s;
+            ttMove = e.move;
+        }
+
+        int alpha0 = alpha, best = -INF, bestMove = -1;
+        for (int i = -1; i < v.cells && alpha < beta; i++)
+        {
+            int cell = i < 0 ? ttMove : order[i];
+            if (cell < 0 || (occ >> cell & 1) || (i >= 0 && cell == ttMove))
+                continue;
+            make(cell);
+            // nothing completes a line here, so a full board is a draw
+            int s = occupied() == full ? 0 : -search(-beta, -alpha);
+            unmake(cell);
+            if (s > best)
+            {
+                best = s;
+                bestMove = cell;
+            }
+            alpha = max(alpha, s);
+        }
+        if (tt)
+        {
+            TTEntry out;
+            out.score = toTable(best);
+            out.depth = depth;
+            out.bound = best <= alpha0 ? TT_UPPER : best >= beta ? TT_LOWER : TT_EXACT;
+            out.move = bestMove;
+            tt->store(hash, out, stats);
+        }
+        return best;
+    }
+
+    uint64_t nodes = 0;
+    TTStats stats;
+    const EndgameTable* endgame = nullptr; // one covering this variant, or none
+
+private:
+    int toTable(int s) const { return s > 0 ? s + ply : s < 0 ? s - ply : 0; }
+    int fromTable(int s) const { return s > 0 ? s - ply : s < 0 ? s + ply : 0; }
+
+    const Variant& v;
+    TranspositionTable* tt;
+    uint32_t full;
+    int order[32];
+    uint32_t stones[2] = { 0, 0 };
+    int side = 0, ply = 0;
+    uint64_t hash = 0;
+};
+
+struct SolveResult
+{
+    int score = 0, move = -1;
+    uint64_t nodes = 0;
+    TTStats stats;
+};
+
+// Root moves are handed out to `threads` searchers; tables[t] is the table
+// thread t uses (the same pointer for a shared table, empty for none). The
+// best score so far is shared so later root moves search a narrower window.
+// An endgame table for the variant, if given, answers every node it covers.
+SolveResult solvePosition(const Variant& v, uint32_t x, uint32_t o, const vector<TranspositionTable*>& tables, int threads,
+    const EndgameTable* endgame = nullptr)
+{
+    SolveResult r;
+    r.nodes = 1;
+    TTSearch root(v, nullptr);
+    root.setPosition(x, o);
+    uint32_t full = (1u << v.cells) - 1;
+    vector<int> moves;
+    for (uint32_t e = full & ~root.occupied(); e; e &= e - 1)
+    {
+        int cell = lowestBit32(e);
+        if (root.moverWinsWith(cell))
+        {
+            r.score = TTSearch::WIN - 1;
+            r.move = cell;
+            return r;
+        }
+        moves.push_back(cell);
+    }
+    if (moves.empty())
+        return r;
+
+    // (score, move) packed so one CAS raises both together; the score is biased
+    // by INF so the packed value is never negative and orders like the score
+    auto pack = [](int score, int move) { return (int64_t(score) + TTSearch::INF) * 256 + move; };
+    auto scoreOf = [](int64_t packed) { return int(packed / 256) - TTSearch::INF; };
+    atomic<int64_t> best{ pack(-TTSearch::INF, 0) };
+    atomic<size_t> next{ 0 };
+    vector<SolveResult> perThread(max(1, threads));
+    auto worker = [&](int id)
+        {
+            TTSearch s(v, tables.empty() ? nullptr : tables[id % tables.size()]);
+            s.endgame = endgame && endgame->covers(v.n, v.k) ? endgame : nullptr;
+            s.setPosition(x, o);
+            size_t i;
+            while ((i = next.fetch_add(1)) < moves.size())
+            {
+                int alpha = scoreOf(best.load());
+                s.make(moves[i]);
+                int score = s.occupied() == full ? 0 : -s.search(-TTSearch::INF, -alpha);
+                s.unmake(moves[i]);
+                // only a strict improvement was searched with an open window, so
+                // the move that sets the final value is exact
+                int64_t cur = best.load(), mine = pack(score, moves[i]);
+                while (score > scoreOf(cur) && !best.compare_exchange_weak(cur, mine))
+                    ;
+            }
+            perThread[id].nodes = s.nodes;
+            perThread[id].stats = s.stats;
+        };
+    vector<thread> pool;
+    for (int t = 1; t < (int)perThread.size(); t++)
+        pool.emplace_back(worker, t);
+    worker(0);
+    for (auto& th : pool)
+        th.join();
+
+    int64_t b = best.load();
+    r.score = scoreOf(b);
+    r.move = int(b % 256);
+    for (auto& p : perThread)
+    {
+        r.nodes += p.nodes;
+        r.stats += p.stats;
+    }
+    return r;
+}
+
+// ---------------- Ultimate search ----------------
+void UltimateBoard::play(int m)
+{
+    int sub = m / 9, cell = m % 9;
+    uint16_t& mine = cells[toMove][sub];
+    mine |= uint16_t(1u << cell);
+    if (SUB_WIN[mine])
+    {
+        won[toMove] |= uint16_t(1u << sub);
+        closed |= uint16_t(1u << sub);
+        if (SUB_WIN[won[toMove]])
+            winner = (int8_t)toMove;
+    }
+    else if ((mine | cells[toMove ^ 1][sub]) == SUB_FULL)
+        closed |= uint16_t(1u << sub);
+    if (winner < 0 && closed == SUB_FULL)
+        winner = 2;
+    forced = (closed >> cell & 1) ? -1 : (int8_t)cell;
+    toMove ^= 1;
+    plies++;
+    lastMove = (int8_t)m;
+}
+
+int UltimateBoard::generate(uint8_t* out) const
+{
+    int n = 0;
+    for (uint32_t subs = playable(); subs; subs &= subs - 1)
+    {
+        int sub = lowestBit32(subs);
+        for (uint32_t free = SUB_FULL & ~(cells[0][sub] | cells[1][sub]); free; free &= free - 1)
+            out[n++] = uint8_t(sub * 9 + lowestBit32(free));
+    }
+    return n;
+}
+
+// Iterative-deepening alpha-beta under a wall-clock budget. The tree is far
+// too big to solve, so leaves are scored by a heuristic: open lines on the
+// meta-board and inside each open sub-board, weighted toward the centre.
+// Moves are copy-made (the board is 44 bytes) and ordered by a history table.
+class UltimateSearch
+{
+public:
+    static constexpr int WIN = 1000000, INF = 2000000;
+
+    // best move for the side to move; -1 if there is none
+    int bestMove(const UltimateBoard& b, double budgetMs)
+    {
+        deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, milli>(budgetMs));
+        nodes = 0;
+        depthReached = 0;
+        aborted = false;
+        for (auto& h : history)
+            h.fill(0);
+        uint8_t moves[81];
+        int n = b.generate(moves);
+        if (n == 0)
+            return -1;
+        int best = moves[0];
+        for (int depth = 1; depth <= 81 - b.plies && !aborted; depth++)
+        {
+            int alpha = -INF, iterBest = -1;
+            for (int i = 0; i < n; i++)
+            {
+                UltimateBoard c = b;
+                c.play(moves[i]);
+                int s = -negamax(c, depth - 1, -INF, -alpha, 1);
+                if (aborted)
+                    break;
+                if (s > alpha)
+                {
+                    alpha = s;
+                    iterBest = i;
+                }
+            }
+            if (aborted)
+                break;
+            // search the last best move first next time
+            rotate(moves, moves + iterBest, moves + iterBest + 1);
+            best = moves[0];
+            bestScore = alpha;
+            depthReached = depth;
+            if (abs(alpha) >= WIN - 100)
+                break; // forced result
+        }
+        return best;
+    }
+
+    uint64_t nodes = 0;
+    int depthReached = 0, bestScore = 0;
+    const atomic<bool>* cancel = nullptr; // polled with the clock; set to end the search early
+
+private:
+    int negamax(const UltimateBoard& b, int depth, int alpha, int beta, int ply)
+    {
+        if ((++nodes & 1023) == 0 && (chrono::steady_clock::now() > deadline || (cancel && cancel->load(memory_order_relaxed))))
+            aborted = true;
+        if (aborted)
+            return 0;
+        if (b.over())
+            return b.winner == 2 ? 0 : -(WIN - ply); // the player who just moved won
+        if (depth == 0)
+            return evaluate(b);
+
+        uint8_t moves[81];
+        int n = b.generate(moves);
+        auto& hist = history[b.toMove];
+        // insertion sort by history; lists are short when a sub-board is forced
+        for (int i = 1; i < n; i++)
+        {
+            uint8_t m = moves[i];
+            int j = i;
+            for (; j > 0 && hist[moves[j - 1]] < hist[m]; j--)
+                moves[j] = moves[j - 1];
+            moves[j] = m;
+        }
+        int best = -INF;
+        for (int i = 0; i < n; i++)
+        {
+            UltimateBoard c = b;
+            c.play(moves[i]);
+            int s = -negamax(c, depth - 1, -beta, -alpha, ply + 1);
+            if (s > best)
+                best = s;
+            if (s > alpha)
+                alpha = s;
+            if (alpha >= beta)
+            {
+                hist[moves[i]] += depth * depth;
+                break;
+            }
+        }
+        return best;
+    }
+
+    // for the side to move
+    static int evaluate(const UltimateBoard& b)
+    {
+        static const int SUB_WEIGHT[9] = { 3, 2, 3, 2, 4, 2, 3, 2, 3 };
+        static const int LOCAL_LINE[3] = { 0, 1, 6 }, META_LINE[3] = { 0, 60, 400 };
+        int me = b.toMove, op = me ^ 1, score = 0;
+        // a meta line is still open for a side while none of its sub-boards is
+        // closed against that side
+        uint16_t deadForMe = b.closed & ~b.won[me], deadForOp = b.closed & ~b.won[op];
+        for (uint16_t l : SUB_LINES)
+        {
+            if (!(l & deadForMe))
+                score += META_LINE[min(2, popCount32(b.won[me] & l))];
+            if (!(l & deadForOp))
+                score -= META_LINE[min(2, popCount32(b.won[op] & l))];
+        }
+        for (int s = 0; s < 9; s++)
+        {
+            if (b.won[me] >> s & 1)
+                score += 40 * SUB_WEIGHT[s];
+            else if (b.won[op] >> s & 1)
+                score -= 40 * SUB_WEIGHT[s];
+            else if (!(b.closed >> s & 1))
+            {
+                uint16_t mine = b.cells[me][s], theirs = b.cells[op][s];
+                int local = 0;
+                for (uint16_t l : SUB_LINES)
+                {
+                    if (!(l & theirs))
+                        local += LOCAL_LINE[popCount32(mine & l)];
+                    if (!(l & mine))
+                        local -= LOCAL_LINE[popCount32(theirs & l)];
+                }
+                score += local * SUB_WEIGHT[s];
+            }
+        }
+        // free choice of sub-board is worth something to the mover
+        if (b.forced < 0 || (b.closed >> b.forced & 1))
+            score += 25;
+        return score;
+    }
+
+    chrono::steady_clock::time_point deadline;
+    bool aborted = false;
+    array<array<int, 81>, 2> history{};
+};
+
+int randomUltimateMove(const UltimateBoard& b)
+{
+    uint8_t moves[81];
+    int n = b.generate(moves);
+    if (n == 0)
+        return -1;
+    return moves[uniform_int_distribution<int>(0, n - 1)(rng)];
+}
+
+// per-move search budget for Medium and Hard, small enough to keep the window responsive
+static double searchBudgetMs(Difficulty d) { return d == Difficulty::Hard ? 90.0 : 25.0; }
+
+// Easy plays at random; Medium and Hard search within their budget.
+int ultimateAIMove(const Game& g, const atomic<bool>* cancel = nullptr)
+{
+    if (g.difficulty == Difficulty::Easy)
+        return randomUltimateMove(g.ultimateBoard);
+    UltimateSearch search;
+    search.cancel = cancel;
+    int m = search.bestMove(g.ultimateBoard, searchBudgetMs(g.difficulty));
+    TRACE_NODES(search.nodes);
+    return m;
+}
+
+// --ultimate-bench [ms per move] [games]: raw move generation in random
+// playouts, then the search playing itself and a random mover.
+int runUltimateBenchmark(double budgetMs, int games)
+{
+    uint64_t positions = 0;
+    auto start = chrono::steady_clock::now();
+    double secs = 0;
+    int playouts = 0;
+    while (secs < 1.0)
+    {
+        for (int i = 0; i < 1000; i++, playouts++)
+        {
+            UltimateBoard b;
+            b.reset(true);
+            while (!b.over())
+            {
+                b.play(randomUltimateMove(b));
+                positions++;
+            }
+        }
+        secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    cout << "Random playouts: " << playouts << " games, " << fixed << setprecision(1) << positions / secs / 1e6
+        << " M positions/s\n";
+
+    uint64_t nodes = 0;
+    double searchSecs = 0, slowestMs = 0;
+    long depthSum = 0, moves = 0;
+    int vsRandom[3] = { 0, 0, 0 }; // search wins, random wins, draws
+    for (int gi = 0; gi < games; gi++)
+    {
+        // even games: search against itself; odd games: search against random
+        bool selfPlay = gi % 2 == 0;
+        UltimateBoard b;
+        b.reset(true);
+        int searchSide = (gi / 2) % 2;
+        while (!b.over())
+        {
+            if (!selfPlay && b.toMove != searchSide)
+            {
+                b.play(randomUltimateMove(b));
+                continue;
+            }
+            UltimateSearch s;
+            auto t0 = chrono::steady_clock::now();
+            int m = s.bestMove(b, budgetMs);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+            searchSecs += ms / 1000.0;
+            slowestMs = max(slowestMs, ms);
+            nodes += s.nodes;
+            depthSum += s.depthReached;
+            moves++;
+            b.play(m);
+        }
+        if (!selfPlay)
+            vsRandom[b.winner == 2 ? 2 : b.winner == searchSide ? 0 : 1]++;
+    }
+    if (moves)
+        cout << "Search at " << setprecision(0) << budgetMs << " ms/move: " << moves << " moves, " << setprecision(2)
+            << nodes / max(searchSecs, 1e-9) / 1e6 << " M positions/s, average depth " << setprecision(1)
+            << double(depthSum) / moves << ", slowest move " << slowestMs << " ms\n";
+    cout << "Search vs random: " << vsRandom[0] << " wins, " << vsRandom[1] << " losses, " << vsRandom[2] << " draws\n";
+    return 0;
+}
+
+// ---------------- Qubic search ----------------
+// The 76 lines of the cube and, for each cell, the lines through it (4 or 7).
+struct QubicLines
+{
+    uint64_t lines[76];
+    uint8_t cellLines[64][7];
+    uint8_t cellLineCount[64]{};
+    uint64_t strong = 0; // cells on seven lines: the corners and the centre cube
+
+    QubicLines()
+    {
+        int n = 0;
+        for (int dz = -1; dz <= 1; dz++)
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    // one direction of each opposite pair
+                    int key = dz * 9 + dy * 3 + dx;
+                    if (key <= 0)
+                        continue;
+                    for (int z = 0; z < 4; z++)
+                        for (int y = 0; y < 4; y++)
+                            for (int x = 0; x < 4; x++)
+                            {
+                                // a line starts where the step back leaves the cube and three steps on stay in it
+                                auto inside = [](int v) { return v >= 0 && v < 4; };
+                                if (inside(x - dx) && inside(y - dy) && inside(z - dz))
+                                    continue;
+                                if (!inside(x + 3 * dx) || !inside(y + 3 * dy) || !inside(z + 3 * dz))
+                                    continue;
+                                uint64_t m = 0;
+                                for (int s = 0; s < 4; s++)
+                                    m |= 1ull << ((z + s * dz) * 16 + (y + s * dy) * 4 + (x + s * dx));
+                                lines[n++] = m;
+                            }
+                }
+        for (int l = 0; l < 76; l++)
+            for (uint64_t m = lines[l]; m; m = clearLowestBit64(m))
+            {
+                int c = lowestBit64(m);
+                cellLines[c][cellLineCount[c]++] = (uint8_t)l;
+            }
+        for (int c = 0; c < 64; c++)
+            if (cellLineCount[c] == 7)
+                strong |= 1ull << c;
+    }
+};
+static const QubicLines QUBIC;
+
+void QubicBoard::play(int m)
+{
+    uint64_t& mine = stones[toMove];
+    mine |= 1ull << m;
+    for (int i = 0; i < QUBIC.cellLineCount[m]; i++)
+    {
+        uint64_t l = QUBIC.lines[QUBIC.cellLines[m][i]];
+        if ((mine & l) == l)
+        {
+            winner = (int8_t)toMove;
+            winLine = l;
+        }
+    }
+    if (winner < 0 && (stones[0] | stones[1]) == ~0ull)
+        winner = 2;
+    toMove ^= 1;
+    plies++;
+    lastMove = (int8_t)m;
+}
+
+// Iterative-deepening alpha-beta over the bitboards, sharing the Zobrist-keyed
+// TranspositionTable. Make/unmake keep per-line stone counts, and from them
+// each side's threat cells (empty cells that complete a line) and a score of
+// the lines still open to each side, so a node costs a few table lookups.
+// Threats drive the tree: a mover with a threat wins, two opposing threats
+// lose, and a single opposing threat leaves only the block, which is searched
+// without using up depth.
+class QubicSearch
+{
+public:
+    static constexpr int WIN = 30000, INF = 32000; // fits the table's 16-bit score
+
+    explicit QubicSearch(TranspositionTable* tt) : tt(tt) {}
+
+    int bestMove(const QubicBoard& b, double budgetMs)
+    {
+        deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, milli>(budgetMs));
+        nodes = 0;
+        depthReached = 0;
+        aborted = false;
+        setPosition(b);
+
+        uint64_t empty = ~(stones[0] | stones[1]);
+        if (!empty || b.over())
+            return -1;
+        int best = lowestBit64(empty);
+        for (int depth = 1; depth <= popCount64(empty) && !aborted; depth++)
+        {
+            int move = -1;
+            int score = search(depth, -INF, INF, &move);
+            if (aborted || move < 0)
+                break;
+            best = move;
+            bestScore = score;
+            depthReached = depth;
+            if (abs(score) >= WIN - 100)
+                break; // forced result
+        }
+        return best;
+    }
+
+    uint64_t nodes = 0;
+    int depthReached = 0, bestScore = 0;
+    TTStats stats;
+    const atomic<bool>* cancel = nullptr; // polled with the clock; set to end the search early
+
+private:
+    static constexpr int LINE_WEIGHT[5] = { 0, 1, 6, 40, 0 };
+
+    void setPosition(const QubicBoard& b)
+    {
+        stones[0] = b.stones[0];
+        stones[1] = b.stones[1];
+        side = b.toMove;
+        ply = 0;
+        hash = 0;
+        threats[0] = threats[1] = 0;
+        lineScore[0] = lineScore[1] = 0;
+        memset(threatCount, 0, sizeof(threatCount));
+        for (int s = 0; s < 2; s++)
+            for (uint64_t m = stones[s]; m; m = clearLowestBit64(m))
+                hash ^= ZOBRIST.keys[s][lowestBit64(m)];
+        // either side may open, so the same stones recur with the other to move
+        if (side == 1)
+            hash ^= ZOBRIST.sideKey;
+        for (int l = 0; l < 76; l++)
+        {
+            uint64_t line = QUBIC.lines[l];
+            for (int s = 0; s < 2; s++)
+                count[s][l] = (uint8_t)popCount64(line & stones[s]);
+            for (int s = 0; s < 2; s++)
+                if (count[s ^ 1][l] == 0)
+                {
+                    lineScore[s] += LINE_WEIGHT[count[s][l]];
+                    if (count[s][l] == 3)
+                        addThreat(s, lowestBit64(line & ~stones[s]));
+                }
+        }
+    }
+
+    void addThreat(int s, int cell)
+    {
+        if (threatCount[s][cell]++ == 0)
+            threats[s] |= 1ull << cell;
+    }
+    void removeThreat(int s, int cell)
+    {
+        if (--threatCount[s][cell] == 0)
+            threats[s] &= ~(1ull << cell);
+    }
+
+    void make(int cell)
+    {
+        int s = side, o = s ^ 1;
+        uint64_t occupied = stones[0] | stones[1] | (1ull << cell);
+        for (int i = 0; i < QUBIC.cellLineCount[cell]; i++)
+        {
+            int l = QUBIC.cellLines[cell][i];
+            int cs = count[s][l], co = count[o][l];
+            if (co == 0)
+            {
+                lineScore[s] += LINE_WEIGHT[cs + 1] - LINE_WEIGHT[cs];
+                if (cs == 2)
+                    addThreat(s, lowestBit64(QUBIC.lines[l] & ~occupied));
+                else if (cs == 3)
+                    removeThreat(s, cell);
+            }
+            else if (cs == 0)
+            {
+                // the line is now dead for the opponent
+                lineScore[o] -= LINE_WEIGHT[co];
+                if (co == 3)
+                    removeThreat(o, cell);
+            }
+            count[s][l]++;
+        }
+        stones[s] |= 1ull << cell;
+        hash ^= ZOBRIST.keys[s][cell] ^ ZOBRIST.sideKey;
+        side = o;
+        ply++;
+    }
+
+    void unmake(int cell)
+    {
+        int s = side ^ 1, o = side;
+        stones[s] &= ~(1ull << cell);
+        hash ^= ZOBRIST.keys[s][cell] ^ ZOBRIST.sideKey;
+        side = s;
+        ply--;
+        uint64_t occupied = stones[0] | stones[1] | (1ull << cell);
+        for (int i = 0; i < QUBIC.cellLineCount[cell]; i++)
+        {
+            int l = QUBIC.cellLines[cell][i];
+            int cs = --count[s][l], co = count[o][l];
+            if (co == 0)
+            {
+                lineScore[s] -= LINE_WEIGHT[cs + 1] - LINE_WEIGHT[cs];
+                if (cs == 2)
+                    removeThreat(s, lowestBit64(QUBIC.lines[l] & ~occupied));
+                else if (cs == 3)
+                    addThreat(s, cell);
+            }
+            else if (cs == 0)
+            {
+                lineScore[o] += LINE_WEIGHT[co];
+                if (co == 3)
+                    addThreat(o, cell);
+            }
+        }
+    }
+
+    int search(int depth, int alpha, int beta, int* rootMove = nullptr)
+    {
+        if ((++nodes & 1023) == 0 && (chrono::steady_clock::now() > deadline || (cancel && cancel->load(memory_order_relaxed))))
+            aborted = true;
+        if (aborted)
+            return 0;
+        uint64_t empty = ~(stones[0] | stones[1]);
+        if (!empty)
+            return 0;
+        if (threats[side])
+        {
+            if (rootMove)
+                *rootMove = lowestBit64(threats[side]);
+            return WIN - (ply + 1);
+        }
+        uint64_t blocks = threats[side ^ 1];
+        if (blocks && !rootMove)
+        {
+            if (popCount64(blocks) >= 2)
+                return -(WIN - (ply + 2));
+        }
+        else if (depth <= 0)
+            return lineScore[side] - lineScore[side ^ 1];
+        int ttMove = -1;
+        TTEntry e;
+        if (tt && tt->probe(hash, e, stats))
+        {
+            int s = fromTable(e.score);
+            if (!rootMove && e.depth >= depth
+                && (e.bound == TT_EXACT || (e.bound == TT_LOWER && s >= beta) || (e.bound == TT_UPPER && s <= alpha)))
+                return s;
+            ttMove = e.move;
+        }
+
+        // a lone threat must be blocked; anything else loses at once
+        uint64_t candidates = blocks ? blocks : empty;
+        int nextDepth = popCount64(blocks) == 1 ? depth : depth - 1;
+        int alpha0 = alpha, best = -INF, bestMove = -1;
+        auto tryMove = [&](int cell)
+            {
+                make(cell);
+                int s = -search(nextDepth, -beta, -alpha);
+                unmake(cell);
+                if (s > best)
+                {
+                    best = s;
+                    bestMove = cell;
+                }
+                alpha = max(alpha, s);
+            };
+        if (ttMove >= 0 && (candidates >> ttMove & 1))
+            tryMove(ttMove);
+        // cells on seven lines first
+        for (int pass = 0; pass < 2 && alpha < beta && !aborted; pass++)
+            for (uint64_t m = candidates & (pass == 0 ? QUBIC.strong : ~QUBIC.strong); m && alpha < beta && !aborted; m = clearLowestBit64(m))
+            {
+                int cell = lowestBit64(m);
+                if (cell != ttMove)
+                    tryMove(cell);
+            }
+        if (aborted)
+            return 0;
+        if (rootMove)
+            *rootMove = bestMove;
+        if (tt)
+        {
+            TTEntry out;
+            out.score = toTable(best);
+            out.depth = max(0, depth);
+            out.bound = best <= alpha0 ? TT_UPPER : best >= beta ? TT_LOWER : TT_EXACT;
+            out.move = bestMove;
+            tt->store(hash, out, stats);
+        }
+        return best;
+    }
+
+    int toTable(int s) const { return s >= WIN - 100 ? s + ply : s <= -(WIN - 100) ? s - ply : s; }
+    int fromTable(int s) const { return s >= WIN - 100 ? s - ply : s <= -(WIN - 100) ? s + ply : s; }
+
+    TranspositionTable* tt;
+    chrono::steady_clock::time_point deadline;
+    bool aborted = false;
+    uint64_t stones[2] = { 0, 0 }, hash = 0;
+    int side = 0, ply = 0;
+    uint8_t count[2][76];       // stones of each side on each line
+    uint8_t threatCount[2][64]; // lines that cell completes for each side
+    uint64_t threats[2] = { 0, 0 };
+    int lineScore[2] = { 0, 0 };
+};
+
+int randomQubicMove(const QubicBoard& b)
+{
+    uint64_t empty = ~(b.stones[0] | b.stones[1]);
+    int n = popCount64(empty);
+    if (n == 0)
+        return -1;
+    for (int skip = uniform_int_distribution<int>(0, n - 1)(rng); skip > 0; skip--)
+        empty = clearLowestBit64(empty);
+    return lowestBit64(empty);
+}
+
+// Easy plays at random; Medium and Hard search within their budget, reusing
+// one table across moves, pondered ones included.
+int qubicAIMove(const Game& g, const atomic<bool>* cancel = nullptr)
+{
+    if (g.difficulty == Difficulty::Easy)
+        return randomQubicMove(g.qubicBoard);
+    static TranspositionTable table(16);
+    QubicSearch search(&table);
+    search.cancel = cancel;
+    int m = search.bestMove(g.qubicBoard, searchBudgetMs(g.difficulty));
+    TRACE_NODES(search.nodes);
+    return m;
+}
+
+// --qubic-bench [ms per move] [games]: random playouts through the per-cell
+// line masks, then the search playing itself and a random mover.
+int runQubicBenchmark(double budgetMs, int games)
+{
+    uint64_t positions = 0;
+    auto start = chrono::steady_clock::now();
+    double secs = 0;
+    int playouts = 0;
+    while (secs < 1.0)
+    {
+        for (int i = 0; i < 1000; i++, playouts++)
+        {
+            QubicBoard b;
+            b.reset(true);
+            while (!b.over())
+            {
+                b.play(randomQubicMove(b));
+                positions++;
+            }
+        }
+        secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    cout << "Random playouts: " << playouts << " games, " << fixed << setprecision(1) << positions / secs / 1e6
+        << " M positions/s\n";
+
+    TranspositionTable table(64);
+    uint64_t nodes = 0;
+    TTStats stats;
+    double searchSecs = 0, slowestMs = 0;
+    long depthSum = 0, moves = 0;
+    int selfPlay[3] = { 0, 0, 0 }, vsRandom[3] = { 0, 0, 0 }; // [X or search wins, O or random wins, draws]
+    for (int gi = 0; gi < games; gi++)
+    {
+        bool self = gi % 2 == 0;
+        int searchSide = (gi / 2) % 2;
+        QubicBoard b;
+        b.reset(true);
+        while (!b.over())
+        {
+            if (!self && b.toMove != searchSide)
+            {
+                b.play(randomQubicMove(b));
+                continue;
+            }
+            QubicSearch s(&table);
+            auto t0 = chrono::steady_clock::now();
+            int m = s.bestMove(b, budgetMs);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+            searchSecs += ms / 1000.0;
+            slowestMs = max(slowestMs, ms);
+            nodes += s.nodes;
+            stats += s.stats;
+            depthSum += s.depthReached;
+            moves++;
+            b.play(m);
+        }
+        if (self)
+            selfPlay[b.winner]++;
+        else
+            vsRandom[b.winner == 2 ? 2 : b.winner == searchSide ? 0 : 1]++;
+    }
+    if (moves)
+        cout << "Search at " << setprecision(0) << budgetMs << " ms/move: " << moves << " moves, " << setprecision(2)
+            << nodes / max(searchSecs, 1e-9) / 1e6 << " M nodes/s, average depth " << setprecision(1)
+            << double(depthSum) / moves << ", slowest move " << slowestMs << " ms, table hits "
+            << 100.0 * stats.hits / max<uint64_t>(1, stats.probes) << "%\n";
+    cout << "Self-play: X " << selfPlay[0] << ", O " << selfPlay[1] << ", draws " << selfPlay[2] << "\n";
+    cout << "Search vs random: " << vsRandom[0] << " wins, " << vsRandom[1] << " losses, " << vsRandom[2] << " draws\n";
+    return 0;
+}
+
+// ---------------- AI ----------------
+int randomEmptyCell(const array<Piece, ClassicBoard::CELLS>& b)
+{
+    auto e = emptyIndices(b);
+    if (e.empty())
+        return -1;
+    uniform_int_distribution<int> d(0, (int)e.size() - 1);
+    return e[d(rng)];
+}
+
+int easyAIMove(const Game& g)
+{
+    return randomEmptyCell(g.board);
+}
+
+// walks each line cell by cell on the array
+int evaluateBoard(const array<Piece, ClassicBoard::CELLS>& b, Piece aiPiece)
+{
+    for (ClassicBoard::Mask line : ClassicBoard::LINES)
+    {
+        Piece a = b[lowestBit32(line)];
+        bool won = a != Piece::Empty;
+        for (ClassicBoard::Mask m = line & (line - 1); won && m; m &= m - 1)
+            won = b[lowestBit32(m)] == a;
+        if (won)
+            return (a == aiPiece) ? 10 : -10;
+    }
+    return 0;
+}
+
+// Search on the array board; bestMoveFor now uses boardMinimax, and this is
+// kept as the baseline for --board-bench.
+int minimax(array<Piece, ClassicBoard::CELLS>& b, bool maxing, int alpha, int beta, Piece aiPiece)
+{
+    Piece humanPiece = (aiPiece == Piece::X) ? Piece::O : Piece::X;
+    int score = evaluateBoard(b, aiPiece);
+    if (score == 10 || score == -10)
+        return score;
+    if (isBoardFull(b))
+        return 0;
+    if (maxing)
+    {
+        int best = -10000;
+        for (int i = 0; i < ClassicBoard::CELLS; ++i)
+            if (b[i] == Piece::Empty)
+            {
+                b[i] = aiPiece;
+                best = max(best, minimax(b, false, alpha, beta, aiPiece));
+                b[i] = Piece::Empty;
+                alpha = max(alpha, best);
+                if (beta <= alpha)
+                    break;
+            }
+        return best;
+    }
+    else
+    {
+        int best = 10000;
+        for (int i = 0; i < ClassicBoard::CELLS; ++i)
+            if (b[i] == Piece::Empty)
+            {
+                b[i] = humanPiece;
+                best = min(best, minimax(b, true, alpha, beta, aiPiece));
+                b[i] = Piece::Empty;
+                beta = min(beta, best);
+                if (beta <= alpha)
+                    break;
+            }
+        return best;
+    }
+}
+
+// minimax on masks: the same scores (+10 / -10 / 0 for the AI) and cell
+// order, so the same values, with the cell loop unrolled and each win test
+// specialized to the cell just played
+template <class B>
+int boardMinimax(typename B::Mask ai, typename B::Mask human, bool maxing, int alpha, int beta)
+{
+    TRACE_NODES(1);
+    using Mask = typename B::Mask;
+    Mask occupied = ai | human;
+    if (occupied == B::FULL)
+        return 0;
+    int best = maxing ? -10000 : 10000;
+    B::forEachCell([&](auto c)
+        {
+            constexpr int cell = decltype(c)::value;
+            constexpr Mask bit = Mask(1) << cell;
+            if (occupied & bit)
+                return true;
+            if (maxing)
+            {
+                int v = B::template completesLine<cell>(ai | bit) ? 10 : boardMinimax<B>(ai | bit, human, false, alpha, beta);
+                best = max(best, v);
+                alpha = max(alpha, best);
+            }
+            else
+            {
+                int v = B::template completesLine<cell>(human | bit) ? -10 : boardMinimax<B>(ai, human | bit, true, alpha, beta);
+                best = min(best, v);
+                beta = min(beta, best);
+            }
+            return alpha < beta;
+        });
+    return best;
+}
+
+// Perfect-play move for aiPiece: the endgame table, else a full search
+int bestMoveFor(array<Piece, ClassicBoard::CELLS>& b, Piece aiPiece)
+{
+    int tableMove = endgameBestMove(b, aiPiece);
+    if (tableMove >= 0)
+        return tableMove;
+    Piece humanPiece = (aiPiece == Piece::X) ? Piece::O : Piece::X;
+    ClassicBoard::Mask ai = ClassicBoard::maskOf(b, aiPiece), human = ClassicBoard::maskOf(b, humanPiece);
+    int bestVal = -10000, bestIdx = -1;
+    for (int i = 0; i < ClassicBoard::CELLS; ++i)
+        if (b[i] == Piece::Empty)
+        {
+            ClassicBoard::Mask mine = ai | (1u << i);
+            int val = ClassicBoard::completesLine(mine, i) ? 10 : boardMinimax<ClassicBoard>(mine, human, false, -10000, 10000);
+            if (val > bestVal)
+            {
+                bestVal = val;
+                bestIdx = i;
+            }
+        }
+    if (bestIdx == -1)
+        return randomEmptyCell(b);
+    return bestIdx;
+}
+
+int hardAIMove(Game& g)
+{
+    return bestMoveFor(g.board, g.player2Piece); // AI always assigned to player2
+}
+
+int mediumAIMove(Game& g)
+{
+    float r = uniform_real_distribution<float>(0.f, 1.f)(rng);
+    if (r > 0.4f)
+        return hardAIMove(g);
+    return easyAIMove(g);
+}
+
+int chooseAIMove(Game& g)
+{
+    TRACE_SCOPE_NODES("chooseAIMove");
+    if (g.finished)
+        return -1;
+    if (g.mode == GameMode::Ultimate)
+        return ultimateAIMove(g);
+    if (g.mode == GameMode::Qubic)
+        return qubicAIMove(g);
+    switch (g.difficulty)
+    {
+    case Difficulty::Easy:
+        return easyAIMove(g);
+    case Difficulty::Medium:
+        return mediumAIMove(g);
+    case Difficulty::Hard:
+        return hardAIMove(g);
+    default:
+        return easyAIMove(g);
+    }
+}
+
+// ---------------- Pondering ----------------
+// While the human thinks, a worker thread searches the AI's reply to each
+// move they might make, the one the AI would play in their place first, and
+// caches the replies by position. When the human's move lands the answer is
+// usually waiting. Searches poll a cancel flag along with their clock, so
+// stop() returns within a fraction of a millisecond and the frame loop never
+// waits on it. Classic games are not pondered: their replies come straight
+// from the endgame table.
+class Ponderer
+{
+public:
+    ~Ponderer() { stop(); }
+
+    // ponder the human's turn in g; a no-op while that position is already pondered
+    void start(const Game& g)
+    {
+        if (!enabled || g.mode == GameMode::Classic || g.difficulty == Difficulty::Easy || !g.humanVsAI || g.finished
+            || g.currentTurnIsAI)
+            return;
+        uint64_t key = positionKey(g);
+        if (key == rootKey)
+            return;
+        stop();
+        rootKey = key;
+        cancel.store(false, memory_order_relaxed);
+        worker = thread(&Ponderer::run, this, g);
+    }
+
+    // returns once the worker has let go of the cache
+    void stop()
+    {
+        cancel.store(true, memory_order_relaxed);
+        if (worker.joinable())
+            worker.join();
+    }
+
+    // the pondered reply for the AI's turn in g, or -1
+    int take(const Game& g)
+    {
+        stop();
+        if (!enabled || g.mode == GameMode::Classic || g.difficulty == Difficulty::Easy)
+            return -1;
+        lookups++;
+        auto it = cache.find(positionKey(g));
+        bool legal = it != cache.end()
+            && (g.mode == GameMode::Ultimate ? g.ultimateBoard.legal(it->second) : g.qubicBoard.legal(it->second));
+        if (!legal)
+            return -1;
+        hits++;
+        return it->second;
+    }
+
+    // new game: nothing cached applies any more
+    void clear()
+    {
+        stop();
+        cache.clear();
+        rootKey = UINT64_MAX;
+    }
+
+    void report(ostream& out) const
+    {
+        if (lookups == 0)
+            return;
+        out << "Pondering: " << hits << " of " << lookups << " AI replies were ready (" << fixed << setprecision(1)
+            << 100.0 * hits / lookups << "%), " << pondered << " replies pondered\n";
+    }
+
+    bool enabled = true;
+
+private:
+    // 64-bit key of an Ultimate or Qubic position, side to move included
+    static uint64_t positionKey(const Game& g)
+    {
+        uint64_t h = (uint64_t)g.mode;
+        auto add = [&h](uint64_t v)
+            {
+                uint64_t z = h ^ (v + 0x9E3779B97F4A7C15ull);
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                h = z ^ (z >> 31);
+            };
+        if (g.mode == GameMode::Qubic)
+        {
+            add(g.qubicBoard.stones[0]);
+            add(g.qubicBoard.stones[1]);
+            add(g.qubicBoard.toMove);
+        }
+        else
+        {
+            const UltimateBoard& b = g.ultimateBoard;
+            for (int s = 0; s < 9; s++)
+                add((uint64_t)b.cells[0][s] << 16 | b.cells[1][s]);
+            add((uint64_t)(uint8_t)b.forced << 8 | b.toMove);
+        }
+        return h;
+    }
+
+    int search(const Game& g) const
+    {
+        return g.mode == GameMode::Ultimate ? ultimateAIMove(g, &cancel) : qubicAIMove(g, &cancel);
+    }
+
+    void run(Game g)
+    {
+        TRACE_THREAD("ponder");
+        uint8_t moves[81];
+        int n = 0;
+        if (g.mode == GameMode::Ultimate)
+            n = g.ultimateBoard.generate(moves);
+        else
+            for (uint64_t e = ~(g.qubicBoard.stones[0] | g.qubicBoard.stones[1]); e; e = clearLowestBit64(e))
+                moves[n++] = (uint8_t)lowestBit64(e);
+        // most likely first: the move the AI itself would make in the human's place
+        int predicted = search(g);
+        for (int i = 0; i < n; i++)
+            if (moves[i] == predicted)
+                rotate(moves, moves + i, moves + i + 1);
+        for (int i = 0; i < n && !cancel.load(memory_order_relaxed); i++)
+        {
+            Game child = g;
+            applyMove(child, moves[i]);
+            if (child.finished)
+                continue;
+            TRACE_SCOPE_NODES("ponder reply");
+            int reply = search(child);
+            if (cancel.load(memory_order_relaxed))
+                break; // cut short: not the answer the AI would give
+            cache[positionKey(child)] = reply;
+            pondered++;
+        }
+    }
+
+    thread worker;
+    atomic<bool> cancel{ false };
+    unordered_map<uint64_t, int> cache; // position after the human's move -> AI reply
+    uint64_t rootKey = UINT64_MAX;
+    uint64_t lookups = 0, hits = 0, pondered = 0;
+};
+
+// ---------------- AI scheduler ----------------
+// Bounded lock-free multi-producer/multi-consumer ring (Vyukov): each cell
+// carries a sequence number that tells producers and consumers whose turn it is.
+template <class T>
+class MpmcQueue
+{
+public:
+    explicit MpmcQueue(size_t capacity)
+    {
+        size_t cap = 2;
+        while (cap < capacity)
+            cap <<= 1;
+        cells.reset(new Cell[cap]);
+        mask = cap - 1;
+        for (size_t i = 0; i < cap; i++)
+            cells[i].seq.store(i, memory_order_relaxed);
+    }
+    bool push(const T& v)
+    {
+        size_t pos = tail.load(memory_order_relaxed);
+        Cell* c;
+        for (;;)
+        {
+            c = &cells[pos & mask];
+            size_t seq = c->seq.load(memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return false; // full
+            else
+                pos = tail.load(memory_order_relaxed);
+        }
+        c->value = v;
+        c->seq.store(pos + 1, memory_order_release);
+        return true;
+    }
+    bool pop(T& out)
+    {
+        size_t pos = head.load(memory_order_relaxed);
+        Cell* c;
+        for (;;)
+        {
+            c = &cells[pos & mask];
+            size_t seq = c->seq.load(memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (dif == 0)
+            {
+                if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return false; // empty
+            else
+                pos = head.load(memory_order_relaxed);
+        }
+        out = c->value;
+        c->seq.store(pos + mask + 1, memory_order_release);
+        return true;
+    }
+    bool emptyApprox() const { return head.load(memory_order_relaxed) >= tail.load(memory_order_relaxed); }
+
+private:
+    struct Cell
+    {
+        atomic<size_t> seq;
+        T value;
+    };
+    unique_ptr<Cell[]> cells;
+    size_t mask = 0;
+    alignas(64) atomic<size_t> head{ 0 };
+    alignas(64) atomic<size_t> tail{ 0 };
+};
+
+enum class AiPriority
+{
+    Interactive = 0, // a player is waiting on this move
+    Background = 1   // analysis, can wait behind every interactive request
+};
+
+struct AiRequest
+{
+    uint64_t tag = 0; // caller's id, returned untouched
+    array<Piece, ClassicBoard::CELLS> board{};
+    Piece aiPiece = Piece::O;
+    Difficulty difficulty = Difficulty::Hard;
+    AiPriority priority = AiPriority::Interactive;
+    int64_t deadlineUs = 0; // steady clock
+    int64_t enqueuedUs = 0;
+};
+
+struct AiResponse
+{
+    uint64_t tag;
+    int move;
+};
+
+inline int64_t steadyMicros()
+{
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Sessions submit requests from any thread; workers pull them in batches,
+// interactive first and by deadline within a batch. The perfect-play move of a
+// position is searched once per batch no matter how many requests share it;
+// Easy/Medium randomness is still drawn per request.
+class AiScheduler
+{
+public:
+    using Completion = function<void(const AiResponse*, size_t)>;
+    static constexpr size_t BATCH = 64;
+    static constexpr int LATENCY_BUCKETS = 24; // log2 microseconds
+
+    struct Metrics
+    {
+        uint64_t submitted = 0, rejected = 0, completed = 0, batches = 0, searches = 0, dedupHits = 0, deadlineMisses = 0;
+        uint64_t latency[LATENCY_BUCKETS]{};
+        double seconds = 0;
+        double latencyPercentileMs(double p) const
+        {
+            uint64_t total = 0, seen = 0;
+            for (uint64_t c : latency)
+                total += c;
+            for (int i = 0; i < LATENCY_BUCKETS; i++)
+            {
+                seen += latency[i];
+                if (total && seen >= p * total)
+                    return (1u << i) / 1000.0; // bucket upper bound
+            }
+            return 0;
+        }
+    };
+
+    explicit AiScheduler(size_t capacity = 1 << 16) : queues{ MpmcQueue<AiRequest>(capacity), MpmcQueue<AiRequest>(capacity) } {}
+    ~AiScheduler() { stop(); }
+
+    void start(int threads, Completion done)
+    {
+        completion = move(done);
+        startUs = steadyMicros();
+        running = true;
+        for (int i = 0; i < threads; i++)
+            workers.emplace_back([this] { run(); });
+    }
+    void stop()
+    {
+        if (!running.exchange(false))
+            return;
+        idleCv.notify_all();
+        for (auto& w : workers)
+            w.join();
+        workers.clear();
+    }
+
+    // false if the queue for that priority is full
+    bool submit(AiRequest r, int64_t budgetUs)
+    {
+        r.enqueuedUs = steadyMicros();
+        r.deadlineUs = r.enqueuedUs + budgetUs;
+        if (!queues[(int)r.priority].push(r))
+        {
+            stats.rejected.fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+        stats.submitted.fetch_add(1, memory_order_relaxed);
+        if (idle.load(memory_order_acquire) > 0)
+            idleCv.notify_one();
+        return true;
+    }
+
+    Metrics metrics() const
+    {
+        Metrics m;
+        m.submitted = stats.submitted.load();
+        m.rejected = stats.rejected.load();
+        m.completed = stats.completed.load();
+        m.batches = stats.batches.load();
+        m.searches = stats.searches.load();
+        m.dedupHits = stats.dedupHits.load();
+        m.deadlineMisses = stats.deadlineMisses.load();
+        for (int i = 0; i < LATENCY_BUCKETS; i++)
+            m.latency[i] = stats.latency[i].load();
+        m.seconds = (steadyMicros() - startUs) / 1e6;
+        return m;
+    }
+
+    static void printMetrics(const Metrics& m, ostream& os)
+    {
+        os << fixed << setprecision(1) << "AI scheduler: " << m.completed << " moves in " << m.seconds << "s ("
+            << (m.seconds > 0 ? m.completed / m.seconds : 0.0) << "/s), " << m.batches << " batches (avg "
+            << (m.batches ? double(m.completed) / m.batches : 0.0) << "), " << m.searches << " searches, "
+            << m.dedupHits << " deduplicated, " << m.deadlineMisses << " past deadline, " << m.rejected << " rejected\n"
+            << setprecision(3) << "AI queue latency ms: p50 <= " << m.latencyPercentileMs(0.5) << ", p99 <= "
+            << m.latencyPercentileMs(0.99) << "\n";
+    }
+
+private:
+    void run()
+    {
+        TRACE_THREAD("ai worker");
+        vector<AiRequest> batch;
+        vector<AiResponse> out;
+        batch.reserve(BATCH);
+        out.reserve(BATCH);
+        struct Slot
+        {
+            uint32_t key;
+            int move;
+        };
+        array<Slot, 2 * BATCH> seen;
+        while (running.load(memory_order_acquire))
+        {
+            batch.clear();
+            AiRequest r;
+            for (auto& q : queues) // interactive queue drains first
+                while (batch.size() < BATCH && q.pop(r))
+                    batch.push_back(r);
+            if (batch.empty())
+            {
+                unique_lock<mutex> lk(idleMutex);
+                idle.fetch_add(1, memory_order_acq_rel);
+                if (queues[0].emptyApprox() && queues[1].emptyApprox())
+                    idleCv.wait_for(lk, chrono::milliseconds(2));
+                idle.fetch_sub(1, memory_order_acq_rel);
+                continue;
+            }
+            stable_sort(batch.begin(), batch.end(), [](const AiRequest& a, const AiRequest& b)
+                { return a.priority != b.priority ? a.priority < b.priority : a.deadlineUs < b.deadlineUs; });
+
+            int64_t now = steadyMicros();
+            for (auto& s : seen)
+                s.key = UINT32_MAX;
+            out.clear();
+            for (auto& req : batch)
+            {
+                int64_t waited = max<int64_t>(1, now - req.enqueuedUs);
+                int bucket = min(LATENCY_BUCKETS - 1, 64 - countLeadingZeros64((uint64_t)waited));
+                stats.latency[bucket].fetch_add(1, memory_order_relaxed);
+                if (now > req.deadlineUs)
+                    stats.deadlineMisses.fetch_add(1, memory_order_relaxed);
+
+                bool wantBest = req.difficulty == Difficulty::Hard
+                    || (req.difficulty == Difficulty::Medium && uniform_real_distribution<float>(0.f, 1.f)(rng) > 0.4f);
+                int move;
+                if (!wantBest)
+                    move = randomEmptyCell(req.board);
+                else
+                {
+                    uint32_t key = positionKey(req.board, req.aiPiece);
+                    size_t h = (key * 2654435761u) % seen.size();
+                    while (seen[h].key != UINT32_MAX && seen[h].key != key)
+                        h = (h + 1) % seen.size();
+                    if (seen[h].key == key)
+                    {
+                        move = seen[h].move;
+                        stats.dedupHits.fetch_add(1, memory_order_relaxed);
+                    }
+                    else
+                    {
+                        move = bestMoveFor(req.board, req.aiPiece);
+                        seen[h] = { key, move };
+                        stats.searches.fetch_add(1, memory_order_relaxed);
+                    }
+                }
+                out.push_back({ req.tag, move });
+            }
+            stats.completed.fetch_add(out.size(), memory_order_relaxed);
+            stats.batches.fetch_add(1, memory_order_relaxed);
+            completion(out.data(), out.size());
+        }
+    }
+
+    // 2 bits per cell plus the side to move
+    static uint32_t positionKey(const array<Piece, ClassicBoard::CELLS>& b, Piece aiPiece)
+    {
+        uint32_t k = (aiPiece == Piece::X) ? 1u : 0u;
+        for (int i = 0; i < ClassicBoard::CELLS; i++)
+            k = (k << 2) | (uint32_t)b[i];
+        return k;
+    }
+
+    struct Counters
+    {
+        atomic<uint64_t> submitted{ 0 }, rejected{ 0 }, completed{ 0 }, batches{ 0 }, searches{ 0 }, dedupHits{ 0 }, deadlineMisses{ 0 };
+        atomic<uint64_t> latency[LATENCY_BUCKETS]{};
+    };
+
+    MpmcQueue<AiRequest> queues[2];
+    vector<thread> workers;
+    Completion completion;
+    atomic<bool> running{ false };
+    atomic<int> idle{ 0 };
+    mutex idleMutex;
+    condition_variable idleCv;
+    Counters stats;
+    int64_t startUs = 0;
+};
+
+// ---------------- Move hints ----------------
+// Game-theoretic value of every empty cell for the side to move, computed a
+// little at a time so the window never misses a frame. Each frame the
+// analyzer gets a time budget; it deepens one iteration at a time and can
+// stop mid-search. Subtrees it has finished, exactly or to the current depth,
+// are memoized, so the next frame picks up where it stopped. Finished positions are cached whole.
+// --board-bench checks every hint against boardMinimax, the search the AI plays with.
+struct CellHints
+{
+    static constexpr int16_t UNKNOWN = INT16_MIN;
+    array<int16_t, ClassicBoard::CELLS> score; // 1000 - plies for a win, -(1000 - plies) for a loss, 0 draw
+    int best = -1;
+    int depth = 0; // plies searched so far
+    bool complete = false;
+    CellHints() { score.fill(UNKNOWN); }
+};
+
+class HintAnalyzer
+{
+public:
+    HintAnalyzer() : v(makeVariant(BOARD_SIZE, WIN_LENGTH)) {}
+
+    // current hints for the game, advancing the analysis within budgetMs
+    const CellHints& update(const Game& g, double budgetMs)
+    {
+        uint32_t mine = 0, theirs = 0;
+        for (int i = 0; i < ClassicBoard::CELLS; i++)
+            if (g.board[i] == g.turnPiece)
+                mine |= 1u << i;
+            else if (g.board[i] != Piece::Empty)
+                theirs |= 1u << i;
+        int key = slot(mine, theirs);
+        if (key != currentKey)
+        {
+            currentKey = key;
+            current = solved[key]; // a default CellHints until solved
+            working = CellHints();
+            nextCell = 0;
+        }
+        if (current.complete)
+            return current;
+
+        deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, milli>(budgetMs));
+        aborted = false;
+        int empties = v.cells - popCount32(mine | theirs);
+        while (!aborted)
+        {
+            int depth = working.depth + 1; // iteration being computed
+            for (; nextCell < ClassicBoard::CELLS; nextCell++)
+            {
+                uint32_t bit = 1u << nextCell;
+                if ((mine | theirs) & bit)
+                    continue;
+                int16_t s = probeTable(mine, theirs, nextCell);
+                if (s == CellHints::UNKNOWN)
+                    s = negamaxChild(theirs, mine | bit, nextCell, depth - 1);
+                if (aborted)
+                    break;
+                working.score[nextCell] = s;
+            }
+            if (aborted)
+                break;
+            // iteration done: publish it and go one ply deeper
+            working.depth = depth;
+            working.best = -1;
+            bool exact = true;
+            for (int i = 0; i < ClassicBoard::CELLS; i++)
+            {
+                if ((mine | theirs) & (1u << i))
+                    continue;
+                int16_t s = working.score[i];
+                exact = exact && s != CellHints::UNKNOWN;
+                if (s != CellHints::UNKNOWN && (working.best < 0 || working.score[working.best] == CellHints::UNKNOWN || s > working.score[working.best]))
+                    working.best = i;
+            }
+            working.complete = exact || depth >= empties;
+            current = working;
+            nextCell = 0;
+            if (current.complete)
+            {
+                solved[key] = current;
+                break;
+            }
+        }
+        return current;
+    }
+
+private:
+    int16_t probeTable(uint32_t mine, uint32_t theirs, int cell) const
+    {
+        if (!g_endgame.covers(BOARD_SIZE, WIN_LENGTH))
+            return CellHints::UNKNOWN;
+        uint8_t e = g_endgame.probe(theirs, mine | (1u << cell));
+        // the entry is for the opponent after our move
+        int d = egDistance(e) + 1;
+        return egResult(e) == EG_LOSS ? int16_t(1000 - d) : egResult(e) == EG_WIN ? int16_t(-(1000 - d)) : int16_t(0);
+    }
+
+    // score for the player who just played `cell` (theirs, from the child's view)
+    int16_t negamaxChild(uint32_t childMine, uint32_t childTheirs, int cell, int depth)
+    {
+        if (completesLine(v, childTheirs, cell))
+            return 999; // the move itself wins
+        int16_t s = negamax(childMine, childTheirs, depth);
+        return s == CellHints::UNKNOWN ? s : parentScore(s);
+    }
+
+    static int16_t parentScore(int16_t s) { return s > 0 ? int16_t(-(s - 1)) : s < 0 ? int16_t(-(s + 1)) : int16_t(0); }
+
+    // value for the side to move; UNKNOWN if the depth limit or budget cut it short
+    int16_t negamax(uint32_t mine, uint32_t theirs, int depth)
+    {
+        uint32_t full = (1u << v.cells) - 1;
+        if ((mine | theirs) == full)
+            return 0;
+        int key = slot(mine, theirs);
+        if (exact[key] != NOT_STORED)
+            return exact[key];
+        if (depth <= 0)
+            return CellHints::UNKNOWN;
+        if (limited[key].depth >= depth)
+            return limited[key].score;
+        if ((++nodes & 255) == 0 && chrono::steady_clock::now() > deadline)
+            aborted = true;
+        if (aborted)
+            return CellHints::UNKNOWN;
+
+        int16_t best = INT16_MIN + 1;
+        bool unknown = false;
+        for (uint32_t e = full & ~(mine | theirs); e; e &= e - 1)
+        {
+            int c = lowestBit32(e);
+            int16_t s = negamaxChild(theirs, mine | (1u << c), c, depth - 1);
+            if (s == CellHints::UNKNOWN)
+                unknown = true;
+            else if (s > best)
+                best = s;
+        }
+        // with a reply still unexplored only a found win is worth reporting,
+        // and only a fully explored node is exact
+        if (aborted)
+            return CellHints::UNKNOWN;
+        int16_t result = (unknown && best <= 0) ? CellHints::UNKNOWN : best;
+        if (unknown)
+            limited[key] = { result, depth }; // done to this depth: a resumed iteration skips it
+        else
+            exact[key] = best;
+        return result;
+    }
+
+    // every position has a slot, its cells as base-3 digits (1 the mover's,
+    // 2 the opponent's), so the tables are sized once and a frame's analysis
+    // never allocates
+    static constexpr int positionCount()
+    {
+        int n = 1;
+        for (int i = 0; i < ClassicBoard::CELLS; i++)
+            n *= 3;
+        return n;
+    }
+    static int slot(uint32_t mine, uint32_t theirs)
+    {
+        int k = 0;
+        for (int i = ClassicBoard::CELLS - 1; i >= 0; i--)
+            k = k * 3 + int(mine >> i & 1) + 2 * int(theirs >> i & 1);
+        return k;
+    }
+    static constexpr int16_t NOT_STORED = INT16_MAX;
+
+    struct DepthLimited
+    {
+        int16_t score = 0;
+        int depth = 0; // 0: nothing stored
+    };
+
+    Variant v;
+    vector<int16_t> exact = vector<int16_t>(positionCount(), NOT_STORED);
+    vector<DepthLimited> limited = vector<DepthLimited>(positionCount());
+    vector<CellHints> solved = vector<CellHints>(positionCount()); // complete once solved
+    int currentKey = -1;
+    CellHints current, working;
+    int nextCell = 0;
+    chrono::steady_clock::time_point deadline;
+    bool aborted = false;
+    uint32_t nodes = 0;
+};
+
+// ---------------- Leaderboard ----------------
+// File format: txt per line with quoted name: "Player Name": wins,games, win%
+// Example: "Player 1": Wins=0, Games=0, Win%=0.0%
+
+using LBMap = map<string, pair<int, int>>; // name -> (wins,games)
+
+LBMap loadLeaderboard(const string& filename = "leaderboard.txt")
+{
+    TRACE_SCOPE("loadLeaderboard");
+    LBMap board;
+    ifstream in(filename);
+    if (!in.is_open())
+        return board;
+    string line;
+
+    auto parseIntAfter = [&](const string& s, size_t pos) -> int
+        {
+            // find first digit (or optional minus) at or after pos
+            size_t i = pos;
+            while (i < s.size() && !isdigit((unsigned char)s[i]) && s[i] != '-')
+                ++i;
+            if (i >= s.size())
+                return 0;
+            size_t j = i;
+            if (s[j] == '-')
+                ++j;
+            while (j < s.size() && isdigit((unsigned char)s[j]))
+                ++j;
+            try
+            {
+                return stoi(s.substr(i, j - i));
+            }
+            catch (...)
+            {
+                return 0;
+            }
+        };
+
+    while (getline(in, line))
+    {
+        if (line.empty())
+            continue;
+
+        // Extract name (prefer quoted)
+        string name;
+        size_t pos = 0;
+        while (pos < line.size() && isspace((unsigned char)line[pos]))
+            pos++;
+        if (pos < line.size() && line[pos] == '"')
+        {
+            size_t endq = line.find('"', pos + 1);
+            if (endq == string::npos)
+                continue; // malformed
+            name = line.substr(pos + 1, endq - pos - 1);
+            pos = endq + 1;
+        }
+        else
+        {
+            // no quotes: name until first :
+            size_t comma = line.find(':', pos);
+            if (comma == string::npos)
+                continue;
+            name = line.substr(pos, comma - pos);
+            pos = comma + 1;
+        }
+        // Trim name
+        while (!name.empty() && isspace((unsigned char)name.front()))
+            name.erase(name.begin());
+        while (!name.empty() && isspace((unsigned char)name.back()))
+            name.pop_back();
+
+        int wins = 0, games = 0;
+
+        // Attempt to parse labeled format: look for "Wins=" and "Games="
+        size_t wpos = line.find("Wins=", pos);
+        size_t gpos = line.find("Games=", pos);
+        if (wpos != string::npos && gpos != string::npos)
+        {
+            wins = parseIntAfter(line, wpos + 5);
+            games = parseIntAfter(line, gpos + 6);
+        }
+        else
+        {
+            // fallback: try to parse two numbers after the last quote/comma
+            // Collect all integer tokens after pos
+            vector<int> nums;
+            size_t i = pos;
+            while (i < line.size())
+            {
+                // find start of number
+                while (i < line.size() && !isdigit((unsigned char)line[i]) && line[i] != '-')
+                    ++i;
+                if (i >= line.size())
+                    break;
+                size_t j = i;
+                if (line[j] == '-')
+                    ++j;
+                while (j < line.size() && isdigit((unsigned char)line[j]))
+                    ++j;
+                try
+                {
+                    nums.push_back(stoi(line.substr(i, j - i)));
+                }
+                catch (...)
+                {
+                    nums.push_back(0);
+                }
+                i = j;
+            }
+            if (nums.size() >= 2)
+            {
+                wins = nums[0];
+                games = nums[1];
+            }
+            else if (nums.size() == 1)
+            {
+                wins = nums[0];
+                games = 0;
+            }
+            else
+            {
+                wins = 0;
+                games = 0;
+            }
+        }
+
+        board[name] = { wins, games };
+    }
+
+    return board;
+}
+
+static float safeWinPercent(int wins, int games)
+{
+    if (games == 0)
+        return 0.f;
+    return (100.0f * wins) / games;
+}
+void saveLeaderboard(const LBMap& board, const string& filename = "leaderboard.txt")
+{
+    TRACE_SCOPE("saveLeaderboard");
+    ofstream out(filename, ios::trunc);
+    if (!out.is_open())
+        return;
+
+    for (const auto& kv : board)
+    {
+        const string& name = kv.first;
+        int wins = kv.second.first;
+        int games = kv.second.second;
+        float winPercent = safeWinPercent(wins, games);
+
+        out << '"' << name << '"'
+            << ": Wins=" << wins
+            << ", Games=" << games
+            << ", Win%=" << fixed << setprecision(1) << winPercent << "%\n";
+    }
+
+    out.close();
+}
+
+static string aiNameForDifficulty(Difficulty d)
+{
+    switch (d)
+    {
+    case Difficulty::Easy:
+        return string("AI (Easy)");
+    case Difficulty::Medium:
+        return string("AI (Medium)");
+    case Difficulty::Hard:
+        return string("AI (Hard)");
+    default:
+        return string("AI");
+    }
+}
+
+// Ultimate and Qubic results are kept apart from classic ones: "Alice [Qubic]".
+// Only classic games are written to games.txt, so --rate still rebuilds every
+// unsuffixed rating.
+static string modeSuffix(GameMode m)
+{
+    switch (m)
+    {
+    case GameMode::Ultimate:
+        return string(" [Ultimate]");
+    case GameMode::Qubic:
+        return string(" [Qubic]");
+    default:
+        return string();
+    }
+}
+
+// leaderboard names of the players; the AI is listed per difficulty
+static string player1RatedName(const Game& g)
+{
+    return g.player1Name + modeSuffix(g.mode);
+}
+
+static string player2RatedName(const Game& g)
+{
+    if (g.humanVsAI && g.player2Name == "AI")
+        return aiNameForDifficulty(g.difficulty) + modeSuffix(g.mode);
+    return g.player2Name + modeSuffix(g.mode);
+}
+
+// Applies one finished game to an in-memory leaderboard
+void recordResult(LBMap& board, const Game& g)
+{
+    string name1 = player1RatedName(g);
+    string name2 = player2RatedName(g);
+
+    // ensure entries exist
+    if (board.find(name1) == board.end())
+        board[name1] = { 0, 0 };
+    if (board.find(name2) == board.end())
+        board[name2] = { 0, 0 };
+
+    // increment games for both
+    board[name1].second += 1;
+    board[name2].second += 1;
+
+    // increment win for winner (if not draw)
+    if (g.winner == Piece::Empty)
+    {
+        // draw - no wins incremented
+    }
+    else
+    {
+        string winnerName = (g.winner == g.player1Piece) ? name1 : name2;
+        board[winnerName].first += 1;
+    }
+}
+
+void recordResult(LBMap& board, const GameState& s)
+{
+    Game g;
+    unpackGame(s, g);
+    recordResult(board, g);
+}
+
+void updateLeaderboardOnFinish(Game& g, const string& filename = "leaderboard.txt")
+{
+    // ensures this is only called once per finished game
+    if (g.leaderboardUpdated)
+        return;
+    LBMap board = loadLeaderboard(filename);
+    recordResult(board, g);
+    saveLeaderboard(board, filename);
+    g.leaderboardUpdated = true;
+}
+
+// Adds per-name (wins, games) deltas to what is on disk now, so results other
+// processes saved meanwhile are kept rather than overwritten
+void mergeLeaderboard(const LBMap& delta, const string& filename = "leaderboard.txt")
+{
+    LBMap board = loadLeaderboard(filename);
+    for (const auto& kv : delta)
+    {
+        board[kv.first].first += kv.second.first;
+        board[kv.first].second += kv.second.second;
+    }
+    saveLeaderboard(board, filename);
+}
+
+// Helper to write the summary for a name (W/G/Win%) into a caller buffer
+void leaderboardSummaryFor(const LBMap& board, const string& name, char* out, size_t size)
+{
+    auto it = board.find(name);
+    int w = (it == board.end()) ? 0 : it->second.first;
+    int g = (it == board.end()) ? 0 : it->second.second;
+    snprintf(out, size, "%d/%d (%.1f%%)", w, g, safeWinPercent(w, g));
+}
+
+// ---------------- Game records ----------------
+// One finished game per line: player names quoted as in the leaderboard, each
+// followed by its symbol, then the symbol that moved first and the cells in
+// play order. The AI is named with its difficulty, as on the leaderboard.
+// Example: "Alice" X "AI (Hard)" O X: 4 0 8 2 6 3 5
+struct GameRecord
+{
+    string player1, player2;
+    Piece player1Piece = Piece::X, firstPiece = Piece::X;
+    vector<int> moves;
+};
+
+void appendGameRecord(const Game& g, const string& filename = "games.txt")
+{
+    ofstream out(filename, ios::app);
+    if (!out.is_open())
+        return;
+    auto sym = [](Piece p) { return p == Piece::X ? 'X' : 'O'; };
+    Piece first = g.playerFirst ? g.player1Piece : g.player2Piece;
+    out << '"' << player1RatedName(g) << "\" " << sym(g.player1Piece) << " \"" << player2RatedName(g) << "\" " << sym(g.player2Piece)
+        << ' ' << sym(first) << ':';
+    for (int m : g.moves)
+        out << ' ' << m;
+    out << '\n';
+}
+
+bool parseGameRecord(const string& line, GameRecord& r)
+{
+    size_t q1 = line.find('"'), q2 = line.find('"', q1 + 1);
+    size_t q3 = line.find('"', q2 + 1), q4 = line.find('"', q3 + 1);
+    if (q1 == string::npos || q2 == string::npos || q3 == string::npos || q4 == string::npos)
+        return false;
+    size_t colon = line.find(':', q4);
+    if (colon == string::npos)
+        return false;
+    // the next whitespace-separated token in [pos, end) as 'X', 'O' or 0
+    auto symbol = [&](size_t& pos, size_t end)
+        {
+            while (pos < end && isspace((unsigned char)line[pos]))
+                ++pos;
+            size_t start = pos;
+            while (pos < end && !isspace((unsigned char)line[pos]))
+                ++pos;
+            return (pos - start == 1 && (line[start] == 'X' || line[start] == 'O')) ? line[start] : '\0';
+        };
+    size_t pos = q2 + 1;
+    char p1sym = symbol(pos, q3);
+    pos = q4 + 1;
+    symbol(pos, colon); // player 2's symbol follows from player 1's
+    char firstSym = symbol(pos, colon);
+    if (!p1sym || !firstSym)
+        return false;
+    r.player1.assign(line, q1 + 1, q2 - q1 - 1);
+    r.player2.assign(line, q3 + 1, q4 - q3 - 1);
+    r.player1Piece = p1sym == 'X' ? Piece::X : Piece::O;
+    r.firstPiece = firstSym == 'X' ? Piece::X : Piece::O;
+    r.moves.clear();
+    const char* p = line.c_str() + colon + 1;
+    char* end;
+    for (long m = strtol(p, &end, 10); end != p; m = strtol(p, &end, 10))
+    {
+        if (m < 0 || m >= ClassicBoard::CELLS || r.moves.size() == ClassicBoard::CELLS)
+            return false;
+        r.moves.push_back((int)m);
+        p = end;
+    }
+    return true;
+}
+
+// Sets up `g` at the start of the recorded game (no AI: moves come from the record)
+void startRecordedGame(const GameRecord& r, Game& g)
+{
+    g.humanVsAI = false;
+    g.player1Name = r.player1;
+    g.player2Name = r.player2;
+    g.player1Piece = r.player1Piece;
+    g.player2Piece = (r.player1Piece == Piece::X) ? Piece::O : Piece::X;
+    g.playerFirst = (r.firstPiece == r.player1Piece);
+    g.reset();
+}
+
+// ---------------- Ratings ----------------
+// Elo ratings next to the raw win counts, so a draw against "AI (Hard)" counts
+// for more than a win against "AI (Easy)". Each AI difficulty is rated as its
+// own player. A finished game updates the two players in O(1); --rate replays
+// games.txt from scratch when the parameters change.
+//
+// ratings.txt: a parameter line, then one quoted name per line
+//   # K=32 initial=1500
+//   "Alice": Elo=1523.4, Games=12
+struct RatingParams
+{
+    double initial = 1500.0;
+    double k = 32.0;          // doubled for a player's first provisionalGames
+    int provisionalGames = 10;
+};
+
+struct Rating
+{
+    double elo = 1500.0;
+    int games = 0;
+};
+
+struct RatingTable
+{
+    RatingParams params;
+    map<string, Rating> players;
+};
+
+inline double eloExpected(double ra, double rb) { return 1.0 / (1.0 + pow(10.0, (rb - ra) / 400.0)); }
+
+// scoreA: 1 if a won, 0.5 for a draw, 0 if b won
+inline void applyRating(Rating& a, Rating& b, double scoreA, const RatingParams& p)
+{
+    double ea = eloExpected(a.elo, b.elo);
+    double ka = a.games < p.provisionalGames ? 2 * p.k : p.k;
+    double kb = b.games < p.provisionalGames ? 2 * p.k : p.k;
+    a.elo += ka * (scoreA - ea);
+    b.elo -= kb * (scoreA - ea);
+    a.games++;
+    b.games++;
+}
+
+RatingTable loadRatings(const string& filename = "ratings.txt")
+{
+    RatingTable t;
+    ifstream in(filename);
+    string line;
+    while (getline(in, line))
+    {
+        if (line.rfind("#", 0) == 0)
+        {
+            sscanf(line.c_str(), "# K=%lf initial=%lf", &t.params.k, &t.params.initial);
+            continue;
+        }
+        size_t q1 = line.find('"'), q2 = line.find('"', q1 + 1);
+        Rating r;
+        if (q1 == string::npos || q2 == string::npos
+            || sscanf(line.c_str() + q2 + 1, ": Elo=%lf, Games=%d", &r.elo, &r.games) != 2)
+            continue;
+        t.players[line.substr(q1 + 1, q2 - q1 - 1)] = r;
+    }
+    return t;
+}
+
+void saveRatings(const RatingTable& t, const string& filename = "ratings.txt")
+{
+    ofstream out(filename, ios::trunc);
+    if (!out.is_open())
+        return;
+    out << "# K=" << t.params.k << " initial=" << t.params.initial << "\n" << fixed << setprecision(1);
+    for (const auto& kv : t.players)
+        out << '"' << kv.first << "\": Elo=" << kv.second.elo << ", Games=" << kv.second.games << "\n";
+}
+
+// Applies one finished game (same names as the leaderboard)
+void recordRating(RatingTable& t, const Game& g)
+{
+    auto player = [&](const string& name) -> Rating&
+        {
+            auto it = t.players.find(name);
+            if (it == t.players.end())
+                it = t.players.emplace(name, Rating{ t.params.initial, 0 }).first;
+            return it->second;
+        };
+    Rating& a = player(player1RatedName(g));
+    Rating& b = player(player2RatedName(g));
+    double score = g.winner == Piece::Empty ? 0.5 : g.winner == g.player1Piece ? 1.0 : 0.0;
+    applyRating(a, b, score, t.params);
+}
+
+// Applies one finished game on top of what is on disk now, so ratings other
+// windows saved meanwhile are kept; `t` is left holding the saved table
+void updateRatingsOnFinish(RatingTable& t, const Game& g, const string& filename = "ratings.txt")
+{
+    t = loadRatings(filename);
+    recordRating(t, g);
+    saveRatings(t, filename);
+}
+
+// "Elo 1523" ("?" while provisional) into a caller buffer
+void ratingSummaryFor(const RatingTable& t, const string& name, char* out, size_t size)
+{
+    auto it = t.players.find(name);
+    if (it == t.players.end())
+        snprintf(out, size, "Elo %.0f?", t.params.initial);
+    else
+        snprintf(out, size, "Elo %.0f%s", it->second.elo, it->second.games < t.params.provisionalGames ? "?" : "");
+}
+
+// Score for player 1 replayed from a record: 1, 0.5 or 0, or -1 if the moves
+// don't make a finished game.
+float recordScore(const GameRecord& r)
+{
+    uint32_t stones[2] = { 0, 0 }; // [first mover, second]
+    for (size_t i = 0; i < r.moves.size(); i++)
+    {
+        uint32_t bit = 1u << r.moves[i];
+        if ((stones[0] | stones[1]) & bit)
+            return -1.f;
+        uint32_t& mine = stones[i & 1];
+        mine |= bit;
+        if (ClassicBoard::completesLine(mine, r.moves[i]))
+            {
+                if (i + 1 != r.moves.size())
+                    return -1.f;
+                bool firstWon = (i & 1) == 0;
+                return firstWon == (r.firstPiece == r.player1Piece) ? 1.f : 0.f;
+            }
+    }
+    return r.moves.size() == ClassicBoard::CELLS ? 0.5f : -1.f;
+}
+
+// Synthetic history for benchmarking: players with hidden strengths meet at
+// random and the outcome follows the Elo curve (20% draws). Moves come from a
+// pool of random games with the matching outcome, so every line parses and
+// replays like a real record. Returns the hidden strengths.
+map<string, double> syntheticHistory(size_t games, string& text)
+{
+    map<string, double> strength = { { "AI (Easy)", 1100 }, { "AI (Medium)", 1500 }, { "AI (Hard)", 1900 } };
+    for (int i = 1; i <= 7; i++)
+        strength["Player " + to_string(i)] = 1150 + 100 * i;
+    vector<pair<string, double>> players(strength.begin(), strength.end());
+
+    mt19937 gen(12345);
+    vector<vector<int>> pool[3]; // first mover wins, second mover wins, draw
+    while (pool[0].size() < 200 || pool[1].size() < 200 || pool[2].size() < 200)
+    {
+        GameRecord r;
+        uint32_t used = 0;
+        while (true)
+        {
+            int m;
+            do
+                m = int(gen() % ClassicBoard::CELLS);
+            while (used >> m & 1);
+            used |= 1u << m;
+            r.moves.push_back(m);
+            float s = recordScore(r); // player 1 is the first mover here
+            if (s >= 0)
+            {
+                pool[s == 1.f ? 0 : s == 0.f ? 1 : 2].push_back(r.moves);
+                break;
+            }
+        }
+    }
+
+    text.clear();
+    text.reserve(games * 48);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    for (size_t g = 0; g < games; g++)
+    {
+        size_t a = gen() % players.size(), b = (a + 1 + gen() % (players.size() - 1)) % players.size();
+        double u = unit(gen), pWin = 0.8 * eloExpected(players[a].second, players[b].second);
+        int outcome = u < pWin ? 0 : u < 0.8 ? 1 : 2; // a wins, b wins, draw
+        bool aFirst = gen() & 1, aIsX = gen() & 1;
+        int bucket = outcome == 2 ? 2 : ((outcome == 0) == aFirst ? 0 : 1);
+        const vector<int>& moves = pool[bucket][gen() % pool[bucket].size()];
+        char first = (aFirst == aIsX) ? 'X' : 'O';
+        text += '"' + players[a].first + "\" " + (aIsX ? 'X' : 'O') + " \"" + players[b].first + "\" " + (aIsX ? 'O' : 'X') + ' ' + first + ':';
+        for (int m : moves)
+        {
+            text += ' ';
+            text += char('0' + m);
+        }
+        text += '\n';
+    }
+    return strength;
+}
+
+// Rebuilds every rating from a games.txt-style history. Parsing and replaying
+// the records is split over threads by line ranges; the Elo fold itself runs in
+// order afterwards over interned ids, since each update depends on the last.
+RatingTable replayRatings(const string& text, const RatingParams& params, int threads, double& parseMs, double& foldMs, size_t& rated)
+{
+    struct RatedGame
+    {
+        uint32_t p1, p2; // ids local to the chunk
+        float score;
+    };
+    struct Chunk
+    {
+        size_t begin = 0, end = 0;
+        vector<RatedGame> games;
+        vector<string> names;
+    };
+    // a few chunks per thread, each ending on a line break
+    size_t chunkBytes = max<size_t>(1, text.size() / max<size_t>(1, (size_t)threads * 4));
+    vector<Chunk> chunks;
+    for (size_t at = 0; at < text.size();)
+    {
+        size_t nl = text.find('\n', min(text.size(), at + chunkBytes) - 1);
+        Chunk c;
+        c.begin = at;
+        c.end = nl == string::npos ? text.size() : nl + 1;
+        at = c.end;
+        chunks.push_back(move(c));
+    }
+
+    auto start = chrono::steady_clock::now();
+    atomic<size_t> next{ 0 };
+    auto worker = [&]()
+        {
+            size_t ci;
+            GameRecord r;
+            string line;
+            while ((ci = next.fetch_add(1)) < chunks.size())
+            {
+                Chunk& c = chunks[ci];
+                unordered_map<string, uint32_t> ids;
+                auto intern = [&](const string& name)
+                    {
+                        auto it = ids.find(name);
+                        if (it != ids.end())
+                            return it->second;
+                        c.names.push_back(name);
+                        return ids[name] = (uint32_t)(c.names.size() - 1);
+                    };
+                for (size_t pos = c.begin; pos < c.end;)
+                {
+                    size_t nl = text.find('\n', pos);
+                    if (nl == string::npos || nl > c.end)
+                        nl = c.end;
+                    line.assign(text, pos, nl - pos);
+                    pos = nl + 1;
+                    float s;
+                    if (!parseGameRecord(line, r) || (s = recordScore(r)) < 0)
+                        continue;
+                    c.games.push_back({ intern(r.player1), intern(r.player2), s });
+                }
+            }
+        };
+    vector<thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& th : pool)
+        th.join();
+    auto parsed = chrono::steady_clock::now();
+
+    RatingTable table;
+    table.params = params;
+    unordered_map<string, uint32_t> global;
+    vector<string> names;
+    vector<Rating> ratings;
+    rated = 0;
+    for (const Chunk& c : chunks)
+    {
+        vector<uint32_t> remap(c.names.size());
+        for (size_t i = 0; i < c.names.size(); i++)
+        {
+            auto it = global.find(c.names[i]);
+            if (it == global.end())
+            {
+                it = global.emplace(c.names[i], (uint32_t)names.size()).first;
+                names.push_back(c.names[i]);
+                ratings.push_back({ params.initial, 0 });
+            }
+            remap[i] = it->second;
+        }
+        for (const RatedGame& g : c.games)
+            applyRating(ratings[remap[g.p1]], ratings[remap[g.p2]], g.score, params);
+        rated += c.games.size();
+    }
+    for (size_t i = 0; i < names.size(); i++)
+        table.players[names[i]] = ratings[i];
+    parseMs = chrono::duration<double, milli>(parsed - start).count();
+    foldMs = chrono::duration<double, milli>(chrono::steady_clock::now() - parsed).count();
+    return table;
+}
+
+// --rate [games.txt | synthetic:N] [K] [initial] [threads]
+int runRatingReplay(const string& source, const RatingParams& params, int threads)
+{
+    string text;
+    map<string, double> hidden;
+    bool synthetic = source.rfind("synthetic:", 0) == 0;
+    if (synthetic)
+        hidden = syntheticHistory((size_t)max(1L, atol(source.c_str() + 10)), text);
+    else
+    {
+        ifstream in(source, ios::binary);
+        if (!in.is_open())
+        {
+            cerr << "Cannot open " << source << "\n";
+            return 1;
+        }
+        text.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+
+    double parseMs = 0, foldMs = 0;
+    size_t rated = 0;
+    RatingTable t = replayRatings(text, params, max(1, threads), parseMs, foldMs, rated);
+    cout << rated << " games: parsed on " << max(1, threads) << " threads in " << fixed << setprecision(1) << parseMs
+        << " ms, rated in " << foldMs << " ms (" << setprecision(2) << rated / max(foldMs, 1e-6) / 1000.0 << " M games/s)\n";
+
+    vector<pair<string, Rating>> order(t.players.begin(), t.players.end());
+    sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.second.elo > b.second.elo; });
+    for (const auto& p : order)
+    {
+        cout << "  " << left << setw(16) << p.first << right << setprecision(1) << setw(8) << p.second.elo << setw(10) << p.second.games << " games";
+        if (synthetic)
+            cout << "   (hidden " << setprecision(0) << hidden[p.first] << ")";
+        cout << "\n";
+    }
+    if (!synthetic)
+    {
+        saveRatings(t);
+        cout << defaultfloat << "ratings.txt rewritten with K=" << params.k << " initial=" << params.initial << "\n";
+    }
+    return 0;
+}
+
+// ---------------- UI Helpers ----------------
+struct Button
+{
+    RectangleShape box;
+    Color baseColor, glowColor;
+    bool hovered = false;
+    int id = 0;
+    string label;
+    Text txt; // laid out on first draw, then reused
+    const Font* txtFont = nullptr;
+    int txtSize = 0;
+    Button() = default;
+    Button(float x, float y, float w, float h, Color base, Color glow, int _id, const string& text = "")
+        : baseColor(base), glowColor(glow), id(_id), label(text)
+    {
+        box.setSize(Vector2f(w, h));
+        box.setOrigin(w / 2.f, h / 2.f);
+        box.setPosition(x, y);
+        box.setFillColor(base);
+        box.setOutlineThickness(4.f);
+        box.setOutlineColor(glow);
+    }
+    void draw(RenderTarget& win, float t, const Font& font, int charSize = 18)
+    {
+        int alpha = 90 + int(70 * abs(sin(t * 3.5f)));
+        if (hovered)
+            box.setOutlineColor(Color(glowColor.r, glowColor.g, glowColor.b, alpha));
+        else
+            box.setOutlineColor(glowColor);
+        win.draw(box);
+        if (!label.empty())
+        {
+            if (txtFont != &font || txtSize != charSize)
+            {
+                txt = Text(label, font, charSize);
+                txt.setStyle(Text::Bold);
+                FloatRect tb = txt.getLocalBounds();
+                txt.setOrigin(tb.left + tb.width / 2.f, tb.top + tb.height / 2.f);
+                txt.setPosition(box.getPosition());
+                txtFont = &font;
+                txtSize = charSize;
+            }
+            win.draw(txt);
+        }
+    }
+    bool contains(Vector2i mp) const { return box.getGlobalBounds().contains(Vector2f((float)mp.x, (float)mp.y)); }
+};
+
+// Character sizes (and bold variants) the UI draws with; prewarmGlyphs()
+// rasterizes these so no frame stalls on a first-use glyph.
+struct GlyphSet
+{
+    unsigned size;
+    bool bold;
+};
+static const GlyphSet UI_GLYPHS[] = { {16, false}, {18, false}, {18, true}, {20, false}, {20, true}, {30, false} };
+
+// Startup instrumentation for --startup-timing: time from process start to
+// the first presented frame and the duration of the first FRAMES frames.
+struct StartupTimer
+{
+    static constexpr int FRAMES = 120;
+    bool enabled = false;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now(), last;
+    double fontMs = 0, glyphMs = 0, firstFrameMs = 0;
+    array<double, FRAMES> frameMs{};
+    int frames = 0;
+
+    static double msBetween(chrono::steady_clock::time_point a, chrono::steady_clock::time_point b)
+    {
+        return chrono::duration<double, milli>(b - a).count();
+    }
+    // call right after every display()
+    void framePresented()
+    {
+        if (!enabled || frames > FRAMES)
+            return;
+        auto now = chrono::steady_clock::now();
+        if (frames == 0)
+            firstFrameMs = msBetween(start, now);
+        else
+            frameMs[frames - 1] = msBetween(last, now);
+        last = now;
+        if (++frames > FRAMES)
+            report();
+    }
+    void report() const
+    {
+        double sum = 0, worst = 0;
+        int worstAt = 0, hitches = 0;
+        for (int i = 0; i < FRAMES; i++)
+        {
+            sum += frameMs[i];
+            if (frameMs[i] > worst)
+            {
+                worst = frameMs[i];
+                worstAt = i + 1;
+            }
+            if (frameMs[i] > 25.0) // a missed 60 Hz vsync and then some
+                hitches++;
+        }
+        cout << fixed << setprecision(2) << "Startup: first frame after " << firstFrameMs << " ms (font " << fontMs
+            << " ms, glyph atlas " << glyphMs << " ms)\n"
+            << "First " << FRAMES << " frames: avg " << sum / FRAMES << " ms, worst " << worst << " ms (frame "
+            << worstAt << "), " << hitches << " over 25 ms\n";
+    }
+};
+static StartupTimer g_startup;
+
+void prewarmGlyphs(const Font& font)
+{
+    for (const GlyphSet& g : UI_GLYPHS)
+        for (Uint32 c = 32; c < 127; c++)
+            font.getGlyph(c, g.size, g.bold);
+}
+
+bool loadPreferredFont(Font& font)
+{
+    // embedded copy first: no filesystem probing at startup
+    if (font.loadFromMemory(arial_ttf, arial_ttf_len))
+        return true;
+    const vector<string> cand = {
+        "arial.ttf", "Arial.ttf",
+        "C:\\Windows\\Fonts\\arial.ttf",
+        "/usr/share/fonts/truetype/msttcorefonts/Arial.ttf",
+        "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf" };
+    for (auto& p : cand)
+        if (font.loadFromFile(p))
+            return true;
+    return false;
+}
+
+// drawing board pieces
+Vector2f cellTopLeft(int index)
+{
+    int r = ClassicBoard::rowOf(index), c = ClassicBoard::colOf(index);
+    float x = GAP + c * (CELL_PIX + GAP);
+    float y = BOARD_TOP + GAP + r * (CELL_PIX + GAP);
+    return { x, y };
+}
+
+// where a mouse button event happened; the cursor may have moved on since,
+// so hit tests use this rather than Mouse::getPosition
+static Vector2i clickPos(const Event& ev)
+{
+    return { ev.mouseButton.x, ev.mouseButton.y };
+}
+
+int mousePosToIndex(const Vector2i& mp)
+{
+    float boardLeft = 0.f, boardTop = BOARD_TOP + GAP;
+    if (mp.x < boardLeft + GAP || mp.x >= boardLeft + GAP + BOARD_SIZE * (CELL_PIX + GAP))
+        return -1;
+    if (mp.y < boardTop || mp.y >= boardTop + BOARD_SIZE * (CELL_PIX + GAP))
+        return -1;
+    for (int r = 0; r < BOARD_SIZE; r++)
+        for (int c = 0; c < BOARD_SIZE; c++)
+        {
+            float x = GAP + c * (CELL_PIX + GAP);
+            float y = BOARD_TOP + GAP + r * (CELL_PIX + GAP);
+            if (FloatRect(x, y, CELL_PIX, CELL_PIX).contains((float)mp.x, (float)mp.y))
+                return ClassicBoard::idx(r, c);
+        }
+    return -1;
+}
+
+// Ultimate: each board cell holds a sub-board of three small cells a side
+constexpr int UT_PAD = 6;
+constexpr int UT_CELL = (CELL_PIX - 4 * UT_PAD) / 3;
+
+Vector2f ultimateCellTopLeft(int m)
+{
+    Vector2f tl = cellTopLeft(m / 9);
+    int c = m % 9;
+    return { tl.x + UT_PAD + ClassicBoard::colOf(c) * (UT_CELL + UT_PAD), tl.y + UT_PAD + ClassicBoard::rowOf(c) * (UT_CELL + UT_PAD) };
+}
+
+int mousePosToUltimateMove(const Vector2i& mp)
+{
+    int sub = mousePosToIndex(mp);
+    if (sub < 0)
+        return -1;
+    for (int c = 0; c < 9; c++)
+    {
+        Vector2f tl = ultimateCellTopLeft(sub * 9 + c);
+        if (FloatRect(tl.x, tl.y, UT_CELL, UT_CELL).contains((float)mp.x, (float)mp.y))
+            return sub * 9 + c;
+    }
+    return -1;
+}
+
+// Qubic: the four 4x4 layers stacked down the board area, each sheared so it
+// reads as a horizontal plane seen from the front
+constexpr float QB_ROW_H = 28.f, QB_CELL_W = 100.f, QB_SHEAR = 80.f, QB_LAYER_PITCH = 142.f;
+constexpr float QB_LEFT = (WINDOW_W - 4 * QB_CELL_W - QB_SHEAR) / 2.f;
+
+inline float qubicLayerTop(int layer) { return BOARD_TOP + GAP + 8.f + layer * QB_LAYER_PITCH; }
+
+// left edge of column 0 at a height `ly` below the top of a layer
+inline float qubicRowLeft(float ly) { return QB_LEFT + QB_SHEAR * (1.f - ly / (4 * QB_ROW_H)); }
+
+// corners of cell m: top-left, top-right, bottom-right, bottom-left
+void qubicCellQuad(int m, Vector2f* pts)
+{
+    int row = m / 4 % 4, col = m % 4;
+    float top = qubicLayerTop(m / 16) + row * QB_ROW_H;
+    float left = qubicRowLeft(row * QB_ROW_H) + col * QB_CELL_W, lowLeft = qubicRowLeft((row + 1) * QB_ROW_H) + col * QB_CELL_W;
+    pts[0] = { left, top };
+    pts[1] = { left + QB_CELL_W, top };
+    pts[2] = { lowLeft + QB_CELL_W, top + QB_ROW_H };
+    pts[3] = { lowLeft, top + QB_ROW_H };
+}
+
+int mousePosToQubicMove(const Vector2i& mp)
+{
+    for (int layer = 0; layer < 4; layer++)
+    {
+        float ly = mp.y - qubicLayerTop(layer);
+        if (ly < 0 || ly >= 4 * QB_ROW_H)
+            continue;
+        float lx = mp.x - qubicRowLeft(ly);
+        if (lx < 0 || lx >= 4 * QB_CELL_W)
+            return -1;
+        return layer * 16 + int(ly / QB_ROW_H) * 4 + int(lx / QB_CELL_W);
+    }
+    return -1;
+}
+
+// Shapes below are function statics reused every frame, so drawing a board
+// does not allocate once they exist.
+void drawCellBackground(RenderTarget& win, float x, float y, float w, float h, const Color& fill, const Color& outline, float outlineThickness = 3.f)
+{
+    static RectangleShape rect;
+    rect.setSize(Vector2f(w, h));
+    rect.setPosition(x, y);
+    rect.setFillColor(fill);
+    rect.setOutlineThickness(outlineThickness);
+    rect.setOutlineColor(outline);
+    win.draw(rect);
+}
+
+void drawX(RenderTarget& win, float cx, float cy, float size, Color color, float time, bool pulse, float thickness = 10.f)
+{
+    static RectangleShape g1, g2, r1, r2;
+    if (pulse)
+    {
+        int alpha = 100 + int(120 * abs(sin(time * 4.f)));
+        g1.setSize(Vector2f(size, thickness * 1.6f));
+        g2.setSize(Vector2f(size, thickness * 1.6f));
+        g1.setOrigin(size / 2, thickness * 0.8f);
+        g2.setOrigin(size / 2, thickness * 0.8f);
+        g1.setPosition(cx, cy);
+        g2.setPosition(cx, cy);
+        g1.setRotation(45);
+        g2.setRotation(-45);
+        g1.setFillColor(Color(color.r, color.g, color.b, alpha));
+        g2.setFillColor(Color(color.r, color.g, color.b, alpha));
+        win.draw(g1);
+        win.draw(g2);
+    }
+    r1.setSize(Vector2f(size, thickness));
+    r2.setSize(Vector2f(size, thickness));
+    r1.setOrigin(size / 2, thickness / 2);
+    r2.setOrigin(size / 2, thickness / 2);
+    r1.setPosition(cx, cy);
+    r2.setPosition(cx, cy);
+    r1.setRotation(45);
+    r2.setRotation(-45);
+    r1.setFillColor(color);
+    r2.setFillColor(color);
+    win.draw(r1);
+    win.draw(r2);
+}
+
+void drawO(RenderTarget& win, float cx, float cy, float size, Color color, float time, bool pulse, float thickness = 10.f)
+{
+    static CircleShape glow, circ;
+    float inset = thickness * 0.8f;
+    if (pulse)
+    {
+        glow.setRadius(size / 2 + inset);
+        glow.setOrigin(size / 2 + inset, size / 2 + inset);
+        glow.setPosition(cx, cy);
+        int alpha = 100 + int(110 * abs(sin(time * 4.f)));
+        glow.setFillColor(Color(color.r, color.g, color.b, alpha));
+        win.draw(glow);
+    }
+    circ.setRadius(size / 2 - inset);
+    circ.setOrigin(size / 2 - inset, size / 2 - inset);
+    circ.setPosition(cx, cy);
+    circ.setFillColor(Color::Transparent);
+    circ.setOutlineThickness(thickness);
+    circ.setOutlineColor(color);
+    win.draw(circ);
+}
+
+// Value label and best-move outline for each empty cell
+void drawHints(RenderTarget& win, const Game& g, const CellHints& hints, const Font& font)
+{
+    static array<Text, ClassicBoard::CELLS> labels;
+    static array<int16_t, ClassicBoard::CELLS> shown;
+    static array<bool, ClassicBoard::CELLS> ready{};
+    static RectangleShape bestOutline;
+    for (int i = 0; i < ClassicBoard::CELLS; i++)
+    {
+        if (g.board[i] != Piece::Empty)
+            continue;
+        int16_t s = hints.score[i];
+        if (!ready[i] || shown[i] != s)
+        {
+            char buf[24];
+            Color c(150, 150, 160);
+            if (s == CellHints::UNKNOWN)
+                snprintf(buf, sizeof(buf), "...");
+            else if (s > 0)
+            {
+                snprintf(buf, sizeof(buf), "Win in %d", 1000 - s);
+                c = Color(120, 230, 140);
+            }
+            else if (s < 0)
+            {
+                snprintf(buf, sizeof(buf), "Loss in %d", 1000 + s);
+                c = Color(240, 110, 110);
+            }
+            else
+                snprintf(buf, sizeof(buf), "Draw");
+            labels[i].setFont(font);
+            labels[i].setCharacterSize(16);
+            labels[i].setString(buf);
+            labels[i].setFillColor(c);
+            Vector2f tl = cellTopLeft(i);
+            FloatRect r = labels[i].getLocalBounds();
+            labels[i].setPosition(tl.x + (CELL_PIX - r.width) / 2.f, tl.y + CELL_PIX - 28.f);
+            shown[i] = s;
+            ready[i] = true;
+        }
+        win.draw(labels[i]);
+    }
+    if (hints.best >= 0 && g.board[hints.best] == Piece::Empty)
+    {
+        Vector2f tl = cellTopLeft(hints.best);
+        bestOutline.setSize(Vector2f(CELL_PIX - 8.f, CELL_PIX - 8.f));
+        bestOutline.setPosition(tl.x + 4.f, tl.y + 4.f);
+        bestOutline.setFillColor(Color::Transparent);
+        bestOutline.setOutlineThickness(3.f);
+        bestOutline.setOutlineColor(Color(120, 230, 140));
+        win.draw(bestOutline);
+    }
+}
+
+// Sub-boards the mover may play in are outlined in gold; a won sub-board is
+// dimmed under a large symbol that pulses if it is part of the winning line.
+void drawUltimateBoard(RenderTarget& win, const Game& g, float time)
+{
+    const UltimateBoard& u = g.ultimateBoard;
+    uint16_t playable = u.playable(), metaLine = 0;
+    if (u.winner == 0 || u.winner == 1)
+        for (uint16_t l : SUB_LINES)
+            if ((u.won[u.winner] & l) == l)
+                metaLine = l;
+    for (int sub = 0; sub < 9; sub++)
+    {
+        Vector2f tl = cellTopLeft(sub);
+        Color outline = (playable >> sub & 1) ? Color(200, 180, 40) : Color(68, 76, 90);
+        drawCellBackground(win, tl.x, tl.y, (float)CELL_PIX, (float)CELL_PIX, Color(20, 22, 28), outline, 3.f);
+        for (int c = 0; c < 9; c++)
+        {
+            int m = sub * 9 + c;
+            Vector2f ct = ultimateCellTopLeft(m);
+            Color fill = (m == u.lastMove) ? Color(44, 48, 64) : Color(28, 30, 38);
+            drawCellBackground(win, ct.x, ct.y, (float)UT_CELL, (float)UT_CELL, fill, Color(52, 58, 70), 1.f);
+            float cx = ct.x + UT_CELL / 2.f, cy = ct.y + UT_CELL / 2.f;
+            if (u.cells[0][sub] >> c & 1)
+                drawX(win, cx, cy, UT_CELL * 0.7f, Color(255, 120, 110), time, false, 4.f);
+            else if (u.cells[1][sub] >> c & 1)
+                drawO(win, cx, cy, UT_CELL * 0.8f, Color(110, 190, 255), time, false, 4.f);
+        }
+        bool wonByX = u.won[0] >> sub & 1, wonByO = u.won[1] >> sub & 1;
+        if (wonByX || wonByO)
+        {
+            drawCellBackground(win, tl.x, tl.y, (float)CELL_PIX, (float)CELL_PIX, Color(12, 14, 20, 180), Color::Transparent, 0.f);
+            float cx = tl.x + CELL_PIX / 2.f, cy = tl.y + CELL_PIX / 2.f;
+            bool pulse = metaLine >> sub & 1;
+            if (wonByX)
+                drawX(win, cx, cy, CELL_PIX * 0.6f, Color(255, 120, 110), time, pulse);
+            else
+                drawO(win, cx, cy, CELL_PIX * 0.6f, Color(110, 190, 255), time, pulse);
+        }
+    }
+}
+
+// Four sheared layers, top layer first; the last move is lit and the
+// winning line pulses.
+void drawQubicBoard(RenderTarget& win, const Game& g, float time)
+{
+    static ConvexShape quad(4);
+    const QubicBoard& q = g.qubicBoard;
+    for (int m = 0; m < 64; m++)
+    {
+        Vector2f pts[4], c(0.f, 0.f);
+        qubicCellQuad(m, pts);
+        for (auto& p : pts)
+            c += p * 0.25f;
+        for (int i = 0; i < 4; i++)
+            quad.setPoint(i, c + (pts[i] - c) * 0.9f);
+        quad.setFillColor(m == q.lastMove ? Color(44, 48, 64) : Color(20, 22, 28));
+        quad.setOutlineThickness(1.5f);
+        quad.setOutlineColor(Color(68, 76, 90));
+        win.draw(quad);
+        bool pulse = q.winLine >> m & 1;
+        if (q.stones[0] >> m & 1)
+            drawX(win, c.x, c.y, 22.f, Color(255, 120, 110), time, pulse, 4.f);
+        else if (q.stones[1] >> m & 1)
+            drawO(win, c.x, c.y, 24.f, Color(110, 190, 255), time, pulse, 3.5f);
+    }
+}
+
+void renderBoard(RenderTarget& win, const Game& g, float time, const Font& font, const CellHints* hints = nullptr)
+{
+    static RectangleShape bg(Vector2f(WINDOW_W, WINDOW_H));
+    bg.setFillColor(Color(28, 30, 40));
+    win.draw(bg);
+    if (g.mode == GameMode::Ultimate)
+        drawUltimateBoard(win, g, time);
+    else if (g.mode == GameMode::Qubic)
+        drawQubicBoard(win, g, time);
+    else
+        for (int i = 0; i < ClassicBoard::CELLS; i++)
+        {
+            Vector2f tl = cellTopLeft(i);
+            drawCellBackground(win, tl.x, tl.y, (float)CELL_PIX, (float)CELL_PIX, Color(20, 22, 28), Color(68, 76, 90), 3.f);
+            float cx = tl.x + CELL_PIX / 2.f, cy = tl.y + CELL_PIX / 2.f;
+            bool pulse = (g.finished && find(g.winLine.begin(), g.winLine.end(), i) != g.winLine.end());
+            if (g.board[i] == Piece::X)
+                drawX(win, cx, cy, CELL_PIX * 0.6f, Color(255, 120, 110), time, pulse);
+            else if (g.board[i] == Piece::O)
+                drawO(win, cx, cy, CELL_PIX * 0.6f, Color(110, 190, 255), time, pulse);
+        }
+    if (hints && !g.finished && g.mode == GameMode::Classic)
+        drawHints(win, g, *hints, font);
+    static RectangleShape footer(Vector2f(WINDOW_W, FOOTER_H));
+    footer.setPosition(0, BOARD_TOP + GAP + BOARD_SIZE * (CELL_PIX + GAP));
+    footer.setFillColor(Color(18, 20, 26));
+    win.draw(footer);
+
+    // If finished draw result text in footer
+    static Text res;
+    static const Font* resFont = nullptr;
+    if (resFont != &font)
+    {
+        res = Text("Click to play again", font, 20);
+        res.setFillColor(Color::White);
+        FloatRect r = res.getLocalBounds();
+        res.setPosition((WINDOW_W - r.width) / 2.f, footer.getPosition().y + 10);
+        resFont = &font;
+    }
+    if (g.finished)
+        win.draw(res);
+}
+
+Color pieceColor(Piece p)
+{
+    if (p == Piece::X)
+        return Color(255, 120, 110);
+    if (p == Piece::O)
+        return Color(110, 190, 255);
+    return Color::White;
+}
+
+// Player labels, footer leaderboard lines and the turn/result banner. The
+// strings are only rebuilt by refresh() when the game or leaderboard changes;
+// a frame in between just draws the cached Text objects.
+struct Hud
+{
+    Text p1, p2, lb1, lb2, top;
+    Color topColor = Color::White;
+
+    void refresh(const Game& game, const LBMap& board, const RatingTable& ratings, const Font& font)
+    {
+        auto label = [&](Text& t, const string& s, unsigned size, float x, float y)
+            {
+                t.setFont(font);
+                t.setCharacterSize(size);
+                t.setString(s);
+                t.setPosition(x, y);
+            };
+        label(p1, game.player1Name + " (" + string((game.player1Piece == Piece::X) ? "X" : "O") + ")", 18, 12, 12);
+        p1.setFillColor(pieceColor(game.player1Piece));
+        label(p2, game.player2Name + " (" + string((game.player2Piece == Piece::X) ? "X" : "O") + ")", 18, 12, 36);
+        p2.setFillColor(pieceColor(game.player2Piece));
+
+        // small leaderboard summary and rating in footer for the two current players
+        string key1 = player1RatedName(game), key2 = player2RatedName(game);
+        char summary[64], rating[24];
+        float footerY = BOARD_TOP + GAP + BOARD_SIZE * (CELL_PIX + GAP);
+        leaderboardSummaryFor(board, key1, summary, sizeof(summary));
+        ratingSummaryFor(ratings, key1, rating, sizeof(rating));
+        label(lb1, key1 + ": " + summary + "  " + rating, 16, 12, footerY + 40);
+        lb1.setFillColor(Color::White);
+        leaderboardSummaryFor(board, key2, summary, sizeof(summary));
+        ratingSummaryFor(ratings, key2, rating, sizeof(rating));
+        label(lb2, key2 + ": " + summary + "  " + rating, 16, 12, footerY + 60);
+        lb2.setFillColor(Color::White);
+
+        // Current turn or winner (top center)
+        string topString;
+        if (game.finished)
+        {
+            if (game.winner == Piece::Empty)
+            {
+                topString = "DRAW!";
+                topColor = Color::White;
+            }
+            else
+            {
+                string name = (game.winner == game.player1Piece) ? game.player1Name : game.player2Name;
+                topString = name + " WINS!";
+                topColor = pieceColor(game.winner);
+            }
+        }
+        else
+        {
+            string currName = (game.turnPiece == game.player1Piece) ? game.player1Name : game.player2Name;
+            topString = currName + " (" + string((game.turnPiece == Piece::X) ? "X" : "O") + ")";
+            topColor = pieceColor(game.turnPiece);
+        }
+        label(top, topString, 30, WINDOW_W / 2.f, 60.f);
+        top.setFillColor(topColor);
+        FloatRect r = top.getLocalBounds();
+        top.setOrigin(r.left + r.width / 2.f, r.top + r.height / 2.f);
+    }
+
+    void draw(RenderTarget& win, const Game& game, float t)
+    {
+        win.draw(p1);
+        win.draw(p2);
+        win.draw(lb1);
+        win.draw(lb2);
+        if (!game.finished)
+        {
+            int alpha = 150 + 100 * abs(sin(t * 4.f)); // neon pulse
+            top.setFillColor(Color(topColor.r, topColor.g, topColor.b, (sf::Uint8)alpha));
+        }
+        win.draw(top);
+    }
+};
+
+// restart button top right
+Button makeRestartButton()
+{
+    return Button(WINDOW_W - 90.f, BOARD_TOP / 2.f, 140.f, 40.f, Color(30, 30, 40), Color(200, 180, 40), 99, "Restart");
+}
+
+// one complete game frame (board, HUD, restart button) on any target
+void renderFrame(RenderTarget& win, const Game& game, Hud& hud, Button& restartBtn, float t, const Font& font, const CellHints* hints = nullptr)
+{
+    win.clear();
+    renderBoard(win, game, t, font, hints);
+    hud.draw(win, game, t);
+    // Restart button (top-right)
+    restartBtn.draw(win, t, font, 18);
+}
+
+// ---------------- Menus (blocking loops) ----------------
+int playerTypeMenu(RenderWindow& win, const Font& font)
+{
+    TRACE_SCOPE("menu: player type");
+    vector<Button> btns;
+    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f - 60, 300, 90, Color(30, 30, 40), Color(0, 180, 255), 1, "Human vs Human");
+    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f + 60, 300, 90, Color(30, 30, 40), Color(255, 100, 100), 2, "Human vs AI");
+    Clock clock;
+    while (win.isOpen())
+    {
+        Event ev;
+        while (win.pollEvent(ev))
+        {
+            if (ev.type == Event::Closed)
+                win.close();
+            if (ev.type == Event::MouseButtonPressed && ev.mouseButton.button == Mouse::Left)
+            {
+                Vector2i mp = clickPos(ev);
+                for (auto& b : btns)
+                    if (b.contains(mp))
+                        return b.id;
+            }
+        }
+        Vector2i mp = Mouse::getPosition(win);
+        for (auto& b : btns)
+            b.hovered = b.contains(mp);
+        float t = clock.getElapsedTime().asSeconds();
+        win.clear(Color(20, 22, 28));
+        for (auto& b : btns)
+            b.draw(win, t, font, 20);
+        win.display();
+        g_startup.framePresented();
+    }
+    return 1;
+}
+
+Piece symbolMenu(RenderWindow& win, const Font& font)
+{
+    TRACE_SCOPE("menu: symbol");
+    vector<Button> btns;
+    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f - 60, 200, 80, Color(30, 30, 40), Color(255, 100, 100), 1, "Play as X");
+    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f + 60, 200, 80, Color(30, 30, 40), Color(100, 255, 100), 2, "Play as O");
+    Clock clock;
+    while (win.isOpen())
+    {
+        Event ev;
+        while (win.pollEvent(ev))
+        {
+            if (ev.type == Event::Closed)
+                win.close();
+            if (ev.type == Event::MouseButtonPressed && ev.mouseButton.button == Mouse::Left)
+            {
+                Vector2i mp = clickPos(ev);
+                for (auto& b : btns)
+                    if (b.contains(mp))
+                        return (b.id == 1) ? Piece::X : Piece::O;
+            }
+        }
+        Vector2i mp = Mouse::getPosition(win);
+        for (auto& b : btns)
+            b.hovered = b.contains(mp);
+        float t = clock.getElapsedTime().asSeconds();
+        win.clear(Color(20, 22, 28));
+        for (auto& b : btns)
+            b.draw(win, t, font, 20);
+        win.display();
+        g_startup.framePresented();
+    }
+    return Piece::X;
+}
+
+bool firstTurnMenu(RenderWindow& win, const Font& font, const string& p1, const string& p2, bool vsAI)
+{
+    TRACE_SCOPE("menu: first turn");
+    vector<Button> btns;
+    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f - 60, 260, 80, Color(30, 30, 40), Color(255, 200, 0), 1, p1 + " first");
+    string secondLabel = vsAI ? "AI first" : p2 + " first";
+    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f + 60, 260, 80, Color(30, 30, 40), Color(255, 0, 100), 2, secondLabel);
+    Clock clock;
+    while (win.isOpen())
+    {
+        Event ev;
+        while (win.pollEvent(ev))
+        {
+            if (ev.type == Event::Closed)
+                win.close();
+            if (ev.type == Event::MouseButtonPressed && ev.mouseButton.button == Mouse::Left)
+            {
+                Vector2i mp = clickPos(ev);
+                for (auto& b : btns)
+                    if (b.contains(mp))
+                        return b.id == 1;
+            }
+        }
+        Vector2i mp = Mouse::getPosition(win);
+        for (auto& b : btns)
+            b.hovered = b.contains(mp);
+        float t = clock.getElapsedTime().asSeconds();
+        win.clear(Color(20, 22, 28));
+        for (auto& b : btns)
+            b.draw(win, t, font, 18);
+        win.display();
+        g_startup.framePresented();
+    }
+    return true;
+}
+
+GameMode variantMenu(RenderWindow& win, const Font& font)
+{
+    TRACE_SCOPE("menu: variant");
+    vector<Button> btns;
+    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f - 100, 300, 80, Color(30, 30, 40), Color(0, 180, 255), 1, "Classic");
+    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f, 300, 80, Color(30, 30, 40), Color(200, 180, 40), 2, "Ultimate");
+    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f + 100, 300, 80, Color(30, 30, 40), Color(180, 100, 255), 3, "Qubic 4x4x4");
+    Clock clock;
+    while (win.isOpen())
+    {
+        Event ev;
+        while (win.pollEvent(ev))
+        {
+            if (ev.type == Event::Closed)
+                win.close();
+            if (ev.type == Event::MouseButtonPressed && ev.mouseButton.button == Mouse::Left)
+            {
+                Vector2i mp = clickPos(ev);
+                for (auto& b : btns)
+                    if (b.contains(mp))
+                        return (b.id == 1) ? GameMode::Classic : (b.id == 2) ? GameMode::Ultimate : GameMode::Qubic;
+            }
+        }
+        Vector2i mp = Mouse::getPosition(win);
+        for (auto& b : btns)
+            b.hovered = b.contains(mp);
+        float t = clock.getElapsedTime().asSeconds();
+        win.clear(Color(20, 22, 28));
+        for (auto& b : btns)
+            b.draw(win, t, font, 20);
+        win.display();
+        g_startup.framePresented();
+    }
+    return GameMode::Classic;
+}
+
+Difficulty aiDifficultyMenu(RenderWindow& win, const Font& font)
+{
+    TRACE_SCOPE("menu: difficulty");
+    vector<Button> btns;
+    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f - 80, 220, 70, Color(30, 30, 40), Color(200, 200, 200), 1, "Easy");
+    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f, 220, 70, Color(30, 30, 40), Color(100, 255, 100), 2, "Medium");
+    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f + 80, 220, 70, Color(30, 30, 40), Color(255, 100, 100), 3, "Hard");
+    Clock clock;
+    while (win.isOpen())
+    {
+        Event ev;
+        while (win.pollEvent(ev))
+        {
+            if (ev.type == Event::Closed)
+                win.close();
+            if (ev.type == Event::MouseButtonPressed && ev.mouseButton.button == Mouse::Left)
+            {
+                Vector2i mp = clickPos(ev);
+                for (auto& b : btns)
+                    if (b.contains(mp))
+                        return (b.id == 1) ? Difficulty::Easy : (b.id == 2) ? Difficulty::Medium
+                        : Difficulty::Hard;
+            }
+        }
+        Vector2i mp = Mouse::getPosition(win);
+        for (auto& b : btns)
+            b.hovered = b.contains(mp);
+        float t = clock.getElapsedTime().asSeconds();
+        win.clear(Color(20, 22, 28));
+        for (auto& b : btns)
+            b.draw(win, t, font, 18);
+        win.display();
+        g_startup.framePresented();
+    }
+    return Difficulty::Medium;
+}
+
+// Name input with event handling (Enter confirms)
+string nameInput(RenderWindow& win, const Font& font, const string& prompt)
+{
+    TRACE_SCOPE("menu: name input");
+    RectangleShape box(Vector2f(360.f, 52.f));
+    box.setOrigin(box.getSize().x / 2.f, box.getSize().y / 2.f);
+    box.setPosition(WINDOW_W / 2.f, WINDOW_H / 2.f + 10);
+    box.setFillColor(Color::Transparent);
+    box.setOutlineThickness(2.f);
+    string s;
+    bool done = false;
+    Clock clock;
+    while (win.isOpen() && !done)
+    {
+        Event ev;
+        while (win.pollEvent(ev))
+        {
+            if (ev.type == Event::Closed)
+            {
+                win.close();
+                done = true;
+                break;
+            }
+            if (ev.type == Event::TextEntered)
+            {
+                uint32_t c = ev.text.unicode;
+                if (c == 13)
+                { // Enter
+                    if (!s.empty())
+                        done = true;
+                }
+                else if (c == 8)
+                { // backspace
+                    if (!s.empty())
+                        s.pop_back();
+                }
+                else if (c >= 32 && c < 127 && s.size() < 32)
+                {
+                    s.push_back((char)c);
+                }
+            }
+            if (ev.type == Event::KeyPressed && ev.key.code == Keyboard::Enter)
+            {
+                if (!s.empty())
+                    done = true;
+            }
+        }
+        float t = clock.getElapsedTime().asSeconds();
+        box.setOutlineColor(Color::White);
+        win.clear(Color(20, 22, 28));
+        Text p(prompt, font, 20);
+        p.setFillColor(Color::White);
+        p.setPosition(WINDOW_W / 2.f - 180, WINDOW_H / 2.f - 40);
+        win.draw(p);
+        win.draw(box);
+        Text txt(s.empty() ? string("> ") : s, font, 20);
+        txt.setFillColor(Color::White);
+        txt.setPosition(box.getPosition().x - box.getSize().x / 2.f + 8, box.getPosition().y - box.getSize().y / 2.f + 8);
+        win.draw(txt);
+        win.display();
+        g_startup.framePresented();
+    }
+    return s.empty() ? "Player" : s;
+}
+
+// ---------------- Input latency ----------------
+// Click -> display() latencies in milliseconds, reported as a distribution.
+// Room for CAPACITY moves is reserved up front so add() never allocates on
+// the frame path; later moves are counted but not kept.
+struct LatencyRecorder
+{
+    static constexpr size_t CAPACITY = 1 << 16;
+    vector<double> samples;
+    size_t dropped = 0;
+
+    LatencyRecorder() { samples.reserve(CAPACITY); }
+    void add(double ms)
+    {
+        if (samples.size() < CAPACITY)
+            samples.push_back(ms);
+        else
+            dropped++;
+    }
+    void report(ostream& os, const char* mode) const
+    {
+        if (samples.empty())
+        {
+            os << "Input latency (" << mode << "): no moves recorded\n";
+            return;
+        }
+        vector<double> s = samples;
+        sort(s.begin(), s.end());
+        auto pct = [&](double p) { return s[min(s.size() - 1, (size_t)(p * s.size()))]; };
+        os << fixed << setprecision(2) << "Input->display latency (" << mode << ", " << s.size() << " moves): min " << s.front()
+            << " ms, p50 " << pct(0.5) << ", p90 " << pct(0.9) << ", p99 " << pct(0.99) << ", max " << s.back() << " ms";
+        if (dropped)
+            os << " (" << dropped << " later moves not kept)";
+        os << "\n";
+    }
+};
+
+// Frame pacing without setFramerateLimit: each frame is scheduled to finish at
+// a fixed period. Input is sampled at (present time - expected frame work), so
+// the wait happens before polling rather than after drawing. Sleeps stop short
+// of the target and the last stretch is spun, since OS sleeps overshoot.
+class FramePacer
+{
+public:
+    using Clock = chrono::steady_clock;
+
+    explicit FramePacer(double hz) : period(chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / hz))) { resync(); }
+
+    void resync()
+    {
+        nextPresent = Clock::now() + period;
+        sampledAt = Clock::now();
+    }
+
+    void waitForInputWindow()
+    {
+        auto wake = nextPresent - chrono::duration_cast<Clock::duration>(chrono::duration<double, milli>(workMs + 1.0));
+        auto coarse = wake - chrono::milliseconds(2);
+        if (Clock::now() < coarse)
+            this_thread::sleep_until(coarse);
+        while (Clock::now() < wake)
+            this_thread::yield();
+        sampledAt = Clock::now();
+    }
+
+    void framePresented()
+    {
+        auto now = Clock::now();
+        double work = chrono::duration<double, milli>(now - sampledAt).count();
+        workMs += 0.1 * (work - workMs); // smoothed poll -> present cost
+        nextPresent += period;
+        if (nextPresent < now) // missed a slot: restart the cadence from now
+            nextPresent = now + period;
+    }
+
+private:
+    Clock::duration period;
+    Clock::time_point nextPresent, sampledAt;
+    double workMs = 2.0;
+};
+
+// ---------------- Game server ----------------
+// Many sessions in one process behind a non-blocking epoll reactor. Text
+// protocol, one command per line:
+//   NEW <name> <easy|medium|hard> <X|O> <first|second>
+//   MOVE <session> <cell 0-8>
+//   ANALYZE <board, 9 chars of X O .> <X|O>   (background priority)
+//   QUIT
+// Every accepted command is answered once the AI (if it is its turn) has
+// replied:  STATE <session> <board, 9 chars of X O .> <turn|xwins|owins|draw>
+// A session id is released after the STATE that ends its game.
+// ANALYZE is answered with  BEST <board> <cell>  and anything rejected gets
+// ERR <reason>. A line longer than MAX_LINE bytes is answered with ERR and
+// the connection is closed.
+// Finished games are merged into leaderboard.txt every few seconds. They are
+// not rated or written to games.txt: a session keeps no move list, and the
+// ratings must stay reproducible by --rate from games.txt alone.
+// Listens on localhost only: tcp:<port> (127.0.0.1) or unix:<path>.
+
+string boardString(const array<Piece, ClassicBoard::CELLS>& b)
+{
+    string s(9, '.');
+    for (int i = 0; i < ClassicBoard::CELLS; i++)
+        if (b[i] != Piece::Empty)
+            s[i] = (b[i] == Piece::X) ? 'X' : 'O';
+    return s;
+}
+
+const char* statusWord(const GameState& g)
+{
+    if (!g.finished)
+        return "turn";
+    if (g.winner == (uint32_t)Piece::Empty)
+        return "draw";
+    return g.winner == (uint32_t)Piece::X ? "xwins" : "owins";
+}
+
+#if defined(__linux__)
+
+struct Endpoint
+{
+    bool unixSocket = false;
+    string path;
+    int port = 7777;
+};
+
+bool parseEndpoint(const string& s, Endpoint& ep)
+{
+    if (s.rfind("unix:", 0) == 0)
+    {
+        ep.unixSocket = true;
+        ep.path = s.substr(5);
+        return !ep.path.empty() && ep.path.size() < sizeof(sockaddr_un::sun_path);
+    }
+    string port = s.rfind("tcp:", 0) == 0 ? s.substr(4) : s;
+    ep.unixSocket = false;
+    ep.port = atoi(port.c_str());
+    return ep.port > 0 && ep.port < 65536;
+}
+
+static void setNonBlocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static int openSocket(const Endpoint& ep, bool listening)
+{
+    int fd = socket(ep.unixSocket ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    int rc;
+    if (ep.unixSocket)
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, ep.path.c_str(), sizeof(addr.sun_path) - 1);
+        if (listening)
+            unlink(ep.path.c_str());
+        rc = listening ? ::bind(fd, (sockaddr*)&addr, sizeof(addr)) : connect(fd, (sockaddr*)&addr, sizeof(addr));
+    }
+    else
+    {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)ep.port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        rc = listening ? ::bind(fd, (sockaddr*)&addr, sizeof(addr)) : connect(fd, (sockaddr*)&addr, sizeof(addr));
+    }
+    if (rc < 0 || (listening && listen(fd, SOMAXCONN) < 0))
+    {
+        ::close(fd);
+        return -1;
+    }
+    setNonBlocking(fd);
+    return fd;
+}
+
+static volatile sig_atomic_t g_serverStop = 0;
+
+int runServer(const Endpoint& ep, int workerThreads)
+{
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, [](int) { g_serverStop = 1; });
+    signal(SIGTERM, [](int) { g_serverStop = 1; });
+
+    int listener = openSocket(ep, true);
+    if (listener < 0)
+    {
+        cerr << "Cannot listen on " << (ep.unixSocket ? ep.path : "127.0.0.1:" + to_string(ep.port)) << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    int wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event lev{};
+    lev.events = EPOLLIN;
+    lev.data.fd = listener;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &lev);
+    lev.data.fd = wakeFd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, wakeFd, &lev);
+
+    static constexpr size_t MAX_LINE = 256; // longer than any valid command
+    struct Connection
+    {
+        uint64_t serial = 0;
+        string in, out;
+        bool wantWrite = false;
+        vector<uint32_t> sessions;
+    };
+    // sessions live in one flat array of small PODs
+    struct Session
+    {
+        GameState game;
+        int conn = -1; // -1 = free slot
+        uint32_t generation = 0;
+        bool aiPending = false;
+    };
+    map<int, Connection> conns;
+    vector<Session> sessions;
+    vector<uint32_t> freeSessions;
+
+    // results since the last save, merged into the file so games finished
+    // in a window running alongside are not lost
+    LBMap leaderboardDelta;
+    const uint32_t aiNameId = g_names.intern("AI");
+    bool leaderboardDirty = false;
+    auto lastSave = chrono::steady_clock::now();
+    uint64_t movesServed = 0, gamesFinished = 0;
+
+    // AI work comes back from the scheduler's workers in batches
+    mutex resultsMutex;
+    vector<AiResponse> pendingResults, results;
+    AiScheduler scheduler;
+    scheduler.start(max(1, workerThreads), [&](const AiResponse* r, size_t n)
+        {
+            {
+                lock_guard<mutex> lk(resultsMutex);
+                pendingResults.insert(pendingResults.end(), r, r + n);
+            }
+            uint64_t one = 1;
+            (void)!write(wakeFd, &one, sizeof(one));
+        });
+    // ANALYZE requests in flight: request serial -> (connection fd, connection serial, board)
+    struct Analysis
+    {
+        int fd;
+        uint64_t connSerial;
+        string board;
+    };
+    map<uint64_t, Analysis> analyses;
+    uint64_t nextSerial = 1;
+    constexpr uint64_t ANALYSIS_TAG = 1ull << 63;
+
+    auto flush = [&](int fd, Connection& c)
+        {
+            while (!c.out.empty())
+            {
+                ssize_t n = send(fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+                if (n <= 0)
+                    break;
+                c.out.erase(0, (size_t)n);
+            }
+            bool want = !c.out.empty();
+            if (want != c.wantWrite)
+            {
+                epoll_event ev{};
+                ev.events = EPOLLIN | EPOLLRDHUP | (want ? uint32_t(EPOLLOUT) : 0u);
+                ev.data.fd = fd;
+                epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+                c.wantWrite = want;
+            }
+        };
+
+    // a slot back on the free list; player2 is aiNameId, held while the server runs
+    auto recycle = [&](uint32_t id)
+        {
+            Session& s = sessions[id];
+            g_names.release(s.game.player1);
+            s.conn = -1;
+            s.generation++;
+            freeSessions.push_back(id);
+        };
+
+    auto reply = [&](uint32_t id)
+        {
+            Session& s = sessions[id];
+            auto it = conns.find(s.conn);
+            if (it == conns.end())
+                return;
+            it->second.out += "STATE " + to_string(id) + " " + boardString(boardOf(s.game)) + " " + statusWord(s.game) + "\n";
+            if (s.game.finished && !s.game.leaderboardUpdated)
+            {
+                recordResult(leaderboardDelta, s.game);
+                s.game.leaderboardUpdated = true;
+                leaderboardDirty = true;
+                gamesFinished++;
+                // the final STATE is the last message for this id; recycle the slot
+                auto& owned = it->second.sessions;
+                owned.erase(find(owned.begin(), owned.end(), id));
+                recycle(id);
+            }
+        };
+
+    // hand the session to the AI if it is its move, otherwise answer now
+    auto advance = [&](uint32_t id)
+        {
+            Session& s = sessions[id];
+            if (!s.game.finished && s.game.currentTurnIsAI)
+            {
+                AiRequest req;
+                req.tag = (uint64_t)id << 32 | s.generation;
+                req.board = boardOf(s.game);
+                req.aiPiece = player2PieceOf(s.game);
+                req.difficulty = (Difficulty)s.game.difficulty;
+                req.priority = AiPriority::Interactive;
+                if (scheduler.submit(req, 50000))
+                {
+                    s.aiPending = true;
+                    return;
+                }
+                // queue full: play the move inline rather than stall the session
+                Game g;
+                unpackGame(s.game, g);
+                int m = chooseAIMove(g);
+                if (m >= 0)
+                    applyMove(s.game, m);
+            }
+            reply(id);
+        };
+
+    auto closeConnection = [&](int fd)
+        {
+            auto it = conns.find(fd);
+            if (it == conns.end())
+                return;
+            for (uint32_t id : it->second.sessions)
+                recycle(id);
+            epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+            ::close(fd);
+            conns.erase(it);
+        };
+
+    auto handleLine = [&](int fd, Connection& c, const string& line) -> bool
+        {
+            istringstream ss(line);
+            string cmd;
+            ss >> cmd;
+            if (cmd == "QUIT")
+                return false;
+            if (cmd == "NEW")
+            {
+                string name, diff, sym, order;
+                ss >> name >> diff >> sym >> order;
+                if (name.empty() || (sym != "X" && sym != "O") || (order != "first" && order != "second")
+                    || (diff != "easy" && diff != "medium" && diff != "hard"))
+                {
+                    c.out += "ERR usage: NEW <name> <easy|medium|hard> <X|O> <first|second>\n";
+                    return true;
+                }
+                uint32_t id;
+                if (!freeSessions.empty())
+                {
+                    id = freeSessions.back();
+                    freeSessions.pop_back();
+                }
+                else
+                {
+                    id = (uint32_t)sessions.size();
+                    sessions.emplace_back();
+                }
+                Session& s = sessions[id];
+                s.conn = fd;
+                s.aiPending = false;
+                s.game = GameState();
+                s.game.humanVsAI = 1;
+                s.game.player1 = g_names.intern(name);
+                s.game.player2 = aiNameId;
+                s.game.player1IsX = (sym == "X");
+                s.game.playerFirst = (order == "first");
+                s.game.difficulty = (uint32_t)(diff == "easy" ? Difficulty::Easy : diff == "medium" ? Difficulty::Medium : Difficulty::Hard);
+                resetState(s.game);
+                c.sessions.push_back(id);
+                advance(id);
+                return true;
+            }
+            if (cmd == "MOVE")
+            {
+                long id = -1;
+                int cell = -1;
+                ss >> id >> cell;
+                if (id < 0 || id >= (long)sessions.size() || sessions[id].conn != fd)
+                    c.out += "ERR unknown session\n";
+                else if (cell < 0 || cell >= 9)
+                    c.out += "ERR bad cell\n";
+                else
+                {
+                    Session& s = sessions[id];
+                    if (s.game.finished)
+                        c.out += "ERR game over\n";
+                    else if (s.aiPending || s.game.currentTurnIsAI)
+                        c.out += "ERR not your turn\n";
+                    else if (pieceAt(s.game, cell) != Piece::Empty)
+                        c.out += "ERR cell taken\n";
+                    else
+                    {
+                        applyMove(s.game, cell);
+                        movesServed++;
+                        advance((uint32_t)id);
+                    }
+                }
+                return true;
+            }
+            if (cmd == "ANALYZE")
+            {
+                string board, sym;
+                ss >> board >> sym;
+                AiRequest req;
+                bool ok = board.size() == 9 && (sym == "X" || sym == "O");
+                for (int i = 0; ok && i < ClassicBoard::CELLS; i++)
+                {
+                    ok = board[i] == 'X' || board[i] == 'O' || board[i] == '.';
+                    req.board[i] = board[i] == 'X' ? Piece::X : board[i] == 'O' ? Piece::O : Piece::Empty;
+                }
+                if (!ok)
+                {
+                    c.out += "ERR usage: ANALYZE <board> <X|O>\n";
+                    return true;
+                }
+                uint64_t serial = nextSerial++;
+                req.tag = ANALYSIS_TAG | serial;
+                req.aiPiece = sym == "X" ? Piece::X : Piece::O;
+                req.difficulty = Difficulty::Hard;
+                req.priority = AiPriority::Background;
+                if (scheduler.submit(req, 2000000))
+                    analyses[serial] = { fd, c.serial, board };
+                else
+                    c.out += "ERR busy\n";
+                return true;
+            }
+            c.out += "ERR unknown command\n";
+            return true;
+        };
+
+    cout << "Serving on " << (ep.unixSocket ? "unix:" + ep.path : "127.0.0.1:" + to_string(ep.port))
+        << " with " << max(1, workerThreads) << " AI workers (Ctrl+C to stop)\n";
+
+    vector<epoll_event> events(512);
+    char buf[16384];
+    while (!g_serverStop)
+    {
+        int n = epoll_wait(epfd, events.data(), (int)events.size(), 500);
+        if (n < 0 && errno != EINTR)
+            break;
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == listener)
+            {
+                int cfd;
+                while ((cfd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+                {
+                    if (!ep.unixSocket)
+                    {
+                        int one = 1;
+                        setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    }
+                    epoll_event ev{};
+                    ev.events = EPOLLIN | EPOLLRDHUP;
+                    ev.data.fd = cfd;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &ev);
+                    conns[cfd].serial = nextSerial++;
+                }
+                continue;
+            }
+            if (fd == wakeFd)
+            {
+                uint64_t count;
+                (void)!read(wakeFd, &count, sizeof(count));
+                {
+                    lock_guard<mutex> lk(resultsMutex);
+                    results.swap(pendingResults);
+                }
+                for (auto& r : results)
+                {
+                    if (r.tag & ANALYSIS_TAG)
+                    {
+                        auto a = analyses.find(r.tag & ~ANALYSIS_TAG);
+                        if (a == analyses.end())
+                            continue;
+                        auto it = conns.find(a->second.fd);
+                        if (it != conns.end() && it->second.serial == a->second.connSerial)
+                        {
+                            it->second.out += "BEST " + a->second.board + " " + to_string(r.move) + "\n";
+                            flush(it->first, it->second);
+                        }
+                        analyses.erase(a);
+                        continue;
+                    }
+                    uint32_t id = (uint32_t)(r.tag >> 32);
+                    Session& s = sessions[id];
+                    if (s.generation != (uint32_t)r.tag || s.conn < 0)
+                        continue; // owner went away while the AI was thinking
+                    s.aiPending = false;
+                    if (r.move >= 0 && pieceAt(s.game, r.move) == Piece::Empty)
+                    {
+                        applyMove(s.game, r.move);
+                        movesServed++;
+                    }
+                    int owner = s.conn; // reply() may release the session
+                    reply(id);
+                    auto it = conns.find(owner);
+                    if (it != conns.end())
+                        flush(owner, it->second);
+                }
+                results.clear();
+                continue;
+            }
+            auto it = conns.find(fd);
+            if (it == conns.end())
+                continue;
+            Connection& c = it->second;
+            bool open = !(events[i].events & (EPOLLERR | EPOLLHUP));
+            if (open && (events[i].events & (EPOLLIN | EPOLLRDHUP)))
+            {
+                while (open)
+                {
+                    ssize_t r = recv(fd, buf, sizeof(buf), 0);
+                    if (r <= 0)
+                    {
+                        if (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                            open = false;
+                        break;
+                    }
+                    // lines are handled per read, so only a partial one is ever buffered
+                    c.in.append(buf, (size_t)r);
+                    size_t start = 0, nl;
+                    while (open && (nl = c.in.find('\n', start)) != string::npos)
+                    {
+                        string line = c.in.substr(start, nl - start);
+                        if (!line.empty() && line.back() == '\r')
+                            line.pop_back();
+                        start = nl + 1;
+                        open = handleLine(fd, c, line);
+                    }
+                    c.in.erase(0, start);
+                    if (open && c.in.size() > MAX_LINE)
+                    {
+                        c.out += "ERR line too long\n";
+                        flush(fd, c);
+                        open = false;
+                    }
+                }
+            }
+            if (open)
+                flush(fd, c);
+            else
+                closeConnection(fd);
+        }
+
+        auto now = chrono::steady_clock::now();
+        if (leaderboardDirty && now - lastSave > chrono::seconds(5))
+        {
+            mergeLeaderboard(leaderboardDelta);
+            leaderboardDelta.clear();
+            leaderboardDirty = false;
+            lastSave = now;
+        }
+    }
+
+    scheduler.stop();
+    while (!conns.empty())
+        closeConnection(conns.begin()->first);
+    if (leaderboardDirty)
+        mergeLeaderboard(leaderboardDelta);
+    ::close(wakeFd);
+    ::close(epfd);
+    ::close(listener);
+    if (ep.unixSocket)
+        unlink(ep.path.c_str());
+    cout << "Server stopped: " << movesServed << " moves, " << gamesFinished << " games finished, " << g_names.live()
+        << " names still interned\n";
+    AiScheduler::printMetrics(scheduler.metrics(), cout);
+    return 0;
+}
+
+// Local load generator: keeps `connections` clients each playing random legal
+// moves against the server and reports sustained moves/sec and move latency.
+int runLoadGenerator(const Endpoint& ep, int connections, double seconds, const string& difficulty)
+{
+    signal(SIGPIPE, SIG_IGN);
+    struct Client
+    {
+        int fd = -1;
+        string in, out;
+        bool awaitingMove = false;
+        chrono::steady_clock::time_point sentAt;
+    };
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    vector<Client> clients(connections);
+    auto connectClient = [&](int index) -> bool
+        {
+            Client& c = clients[index];
+            c = Client{};
+            int fd = openSocket(ep, false);
+            if (fd < 0)
+                return false;
+            c.fd = fd;
+            c.out = "NEW bot" + to_string(index) + " " + difficulty + (index % 2 ? " O second\n" : " X first\n");
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLOUT;
+            ev.data.u32 = (uint32_t)index;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+            return true;
+        };
+    auto dropClient = [&](Client& c)
+        {
+            epoll_ctl(epfd, EPOLL_CTL_DEL, c.fd, nullptr);
+            ::close(c.fd);
+            c.fd = -1;
+        };
+    for (int i = 0; i < connections; i++)
+    {
+        if (!connectClient(i))
+        {
+            cerr << "Cannot connect to server: " << strerror(errno) << "\n";
+            return 1;
+        }
+    }
+
+    vector<uint32_t> latencyUs;
+    latencyUs.reserve(1 << 20);
+    uint64_t games = 0, errors = 0;
+    auto start = chrono::steady_clock::now();
+    auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+    vector<epoll_event> events(512);
+    char buf[4096];
+
+    // false when the server rejected something; the session is then abandoned
+    auto onLine = [&](Client& c, int index, const string& line) -> bool
+        {
+            istringstream ss(line);
+            string kind, board, status;
+            long id = -1;
+            ss >> kind >> id >> board >> status;
+            if (c.awaitingMove)
+            {
+                latencyUs.push_back((uint32_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - c.sentAt).count());
+                c.awaitingMove = false;
+            }
+            if (kind != "STATE" || board.size() != 9)
+            {
+                errors++;
+                return false;
+            }
+            if (status != "turn")
+            {
+                games++;
+                c.out += "NEW bot" + to_string(index) + " " + difficulty + (games % 2 ? " O second\n" : " X first\n");
+                return true;
+            }
+            int empty[ClassicBoard::CELLS], ne = 0;
+            for (int i = 0; i < ClassicBoard::CELLS; i++)
+                if (board[i] == '.')
+                    empty[ne++] = i;
+            int cell = empty[uniform_int_distribution<int>(0, ne - 1)(rng)];
+            c.out += "MOVE " + to_string(id) + " " + to_string(cell) + "\n";
+            c.awaitingMove = true;
+            c.sentAt = chrono::steady_clock::now();
+            return true;
+        };
+
+    while (chrono::steady_clock::now() < deadline)
+    {
+        int n = epoll_wait(epfd, events.data(), (int)events.size(), 100);
+        for (int i = 0; i < n; i++)
+        {
+            int index = (int)events[i].data.u32;
+            Client& c = clients[index];
+            if (c.fd < 0)
+                continue;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            {
+                ssize_t r;
+                while ((r = recv(c.fd, buf, sizeof(buf), 0)) > 0)
+                    c.in.append(buf, (size_t)r);
+                bool lost = r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+                bool rejected = false;
+                size_t start = 0, nl;
+                while (!rejected && (nl = c.in.find('\n', start)) != string::npos)
+                {
+                    rejected = !onLine(c, index, c.in.substr(start, nl - start));
+                    start = nl + 1;
+                }
+                c.in.erase(0, start);
+                if (rejected && !lost)
+                {
+                    // end the old session on the server too, then start over
+                    send(c.fd, "QUIT\n", 5, MSG_NOSIGNAL);
+                    dropClient(c);
+                    connectClient(index);
+                    continue;
+                }
+                if (lost)
+                {
+                    if (!rejected)
+                        errors++;
+                    dropClient(c);
+                    continue;
+                }
+            }
+            if (!c.out.empty())
+            {
+                ssize_t w = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+                if (w > 0)
+                    c.out.erase(0, (size_t)w);
+                else if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    errors++;
+                    dropClient(c);
+                    continue;
+                }
+            }
+            epoll_event ev{};
+            ev.events = EPOLLIN | (c.out.empty() ? 0u : uint32_t(EPOLLOUT));
+            ev.data.u32 = (uint32_t)index;
+            epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &ev);
+        }
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    for (auto& c : clients)
+        if (c.fd >= 0)
+            ::close(c.fd);
+    ::close(epfd);
+
+    if (latencyUs.empty())
+    {
+        cerr << "No moves completed\n";
+        return 1;
+    }
+    auto pct = [&](double p)
+        {
+            size_t k = min(latencyUs.size() - 1, (size_t)(p * latencyUs.size()));
+            nth_element(latencyUs.begin(), latencyUs.begin() + k, latencyUs.end());
+            return latencyUs[k] / 1000.0;
+        };
+    cout << fixed << setprecision(1)
+        << connections << " connections, " << elapsed << "s: " << latencyUs.size() << " moves ("
+        << latencyUs.size() / elapsed << " moves/s), " << games << " games, " << errors << " errors\n"
+        << setprecision(3) << "move latency ms: p50 " << pct(0.50) << ", p99 " << pct(0.99) << ", max " << pct(1.0) << "\n";
+    return 0;
+}
+
+#else
+
+struct Endpoint
 {
-    float r = uniform_real_distribution<float>(0.f, 1.f)(rng);
-    if (r > 0.4f)
-        return hardAIMove(g);
-    return easyAIMove(g);
+};
+bool parseEndpoint(const string&, Endpoint&) { return true; }
+int runServer(const Endpoint&, int)
+{
+    cerr << "Server mode needs Linux (epoll)\n";
+    return 1;
+}
+int runLoadGenerator(const Endpoint&, int, double, const string&)
+{
+    cerr << "Load generator needs Linux (epoll)\n";
+    return 1;
 }
 
-int chooseAIMove(Game& g)
+#endif
+
+// ---------------- State benchmark ----------------
+// Plays `count` random games side by side as Game objects and as a flat
+// GameState array, then snapshots the array with one memcpy.
+int runStateBenchmark(size_t count)
 {
-    if (g.finished)
-        return -1;
-    switch (g.difficulty)
-    {
-    case Difficulty::Easy:
-        return easyAIMove(g);
-    case Difficulty::Medium:
-        return mediumAIMove(g);
-    case Difficulty::Hard:
-        return hardAIMove(g);
-    default:
-        return easyAIMove(g);
-    }
+    auto timeIt = [](auto&& fn)
+        {
+            auto t0 = chrono::steady_clock::now();
+            fn();
+            return chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        };
+    uint32_t p1 = g_names.intern("Player 1"), p2 = g_names.intern("Player 2");
+    vector<Game> games;
+    vector<GameState> states;
+    double buildGames = timeIt([&]
+        {
+            games.resize(count);
+            for (auto& g : games)
+            {
+                g.humanVsAI = false;
+                g.reset();
+            }
+        });
+    double buildStates = timeIt([&]
+        {
+            GameState proto;
+            proto.humanVsAI = 0;
+            proto.player1 = p1;
+            proto.player2 = p2;
+            resetState(proto);
+            states.assign(count, proto);
+        });
+    // same move sequence for both: lowest free cell after a per-game rotation
+    double playGames = timeIt([&]
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                Game& g = games[i];
+                for (int ply = 0; !g.finished; ply++)
+                {
+                    int m = (int)((i + ply * 5) % 9);
+                    while (g.board[m] != Piece::Empty)
+                        m = (m + 1) % 9;
+                    applyMove(g, m);
+                }
+            }
+        });
+    double playStates = timeIt([&]
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                GameState& s = states[i];
+                for (int ply = 0; !s.finished; ply++)
+                {
+                    int m = (int)((i + ply * 5) % 9);
+                    while (((s.xMask | s.oMask) >> m) & 1)
+                        m = (m + 1) % 9;
+                    applyMove(s, m);
+                }
+            }
+        });
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; i++)
+        if (ClassicBoard::maskOf(games[i].board, Piece::X) != states[i].xMask || (Piece)states[i].winner != games[i].winner)
+            mismatches++;
+    vector<GameState> snapshot(count);
+    double copy = timeIt([&] { memcpy(snapshot.data(), states.data(), count * sizeof(GameState)); });
+
+    cout << fixed << setprecision(1) << count << " sessions\n"
+        << "  Game:      " << sizeof(Game) << " bytes; build " << buildGames
+        << " ms, play " << playGames << " ms\n"
+        << "  GameState: " << sizeof(GameState) << " bytes; build " << buildStates << " ms, play " << playStates
+        << " ms, snapshot " << (count * sizeof(GameState)) / 1e6 << " MB in " << setprecision(2) << copy << " ms\n"
+        << "  results differ on " << mismatches << " games\n";
+    return mismatches ? 1 : 0;
 }
 
-// ---------------- Leaderboard ----------------
-// File format: txt per line with quoted name: "Player Name": wins,games, win%
-// Example: "Player 1": Wins=0, Games=0, Win%=0.0%
+// ---------------- Allocation gate ----------------
+// Building with -DTTT_ALLOC_CHECK counts every operator new. --alloc-check then
+// plays games through the click -> checkFinish -> chooseAIMove -> apply path
+// and renders steady frames offscreen, with hints analysed and input latency
+// recorded as in the window loop; any allocation after warm-up makes it exit
+// with 1. Run it after changing anything on the move or frame path:
+//   g++ -std=c++17 -O2 -DTTT_ALLOC_CHECK SFML2.6.1.cpp -lsfml-graphics -lsfml-window -lsfml-system -pthread
+//   ./a.out --alloc-check
+#if defined(TTT_ALLOC_CHECK)
+static atomic<uint64_t> g_allocations{ 0 };
 
-using LBMap = map<string, pair<int, int>>; // name -> (wins,games)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete" // new/delete below are the malloc/free pair
+#endif
+void* operator new(size_t n)
+{
+    g_allocations.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(n ? n : 1))
+        return p;
+    throw bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
 
-LBMap loadLeaderboard(const string& filename = "leaderboard.txt")
+int runAllocationCheck()
 {
-    LBMap board;
-    ifstream in(filename);
-    if (!in.is_open())
-        return board;
-    string line;
+    Font font;
+    loadPreferredFont(font);
+    RenderTexture target;
+    target.create(WINDOW_W, WINDOW_H);
+    Button restartBtn = makeRestartButton();
+    Hud hud;
+    LBMap leaderboard;
+    RatingTable ratings;
+    HintAnalyzer hints;
+    LatencyRecorder latency;
+    Game game;
+    game.humanVsAI = true;
+    game.player1Name = "Player 1";
+    game.player2Name = "AI";
 
-    auto parseIntAfter = [&](const string& s, size_t pos) -> int
+    // human moves arrive as clicks on a cell centre, like the window loop
+    auto playGames = [&](int count)
         {
-            // find first digit (or optional minus) at or after pos
-            size_t i = pos;
-            while (i < s.size() && !isdigit((unsigned char)s[i]) && s[i] != '-')
-                ++i;
-            if (i >= s.size())
-                return 0;
-            size_t j = i;
-            if (s[j] == '-')
-                ++j;
-            while (j < s.size() && isdigit((unsigned char)s[j]))
-                ++j;
-            try
+            for (int n = 0; n < count; n++)
             {
-                return stoi(s.substr(i, j - i));
+                game.difficulty = (Difficulty)(1 + n % 3);
+                game.playerFirst = n % 2 == 0;
+                game.reset();
+                while (!game.finished)
+                {
+                    int m;
+                    if (game.currentTurnIsAI)
+                        m = chooseAIMove(game);
+                    else
+                    {
+                        Vector2f tl = cellTopLeft(randomEmptyCell(game.board));
+                        m = mousePosToIndex(Vector2i((int)tl.x + CELL_PIX / 2, (int)tl.y + CELL_PIX / 2));
+                    }
+                    applyMove(game, m);
+                }
             }
-            catch (...)
+        };
+    auto renderFrames = [&](int count)
+        {
+            for (int i = 0; i < count; i++)
             {
-                return 0;
+                const CellHints* shown = game.finished ? nullptr : &hints.update(game, 4.0);
+                renderFrame(target, game, hud, restartBtn, i / 60.f, font, shown);
+                target.display();
+                latency.add(1.0);
             }
         };
 
-    while (getline(in, line))
+    playGames(20);
+    uint64_t before = g_allocations.load();
+    playGames(3000);
+    uint64_t moveAllocs = g_allocations.load() - before;
+
+    // steady frames for a game in progress and for a finished one
+    uint64_t frameAllocs = 0;
+    for (int finishedBoard = 0; finishedBoard < 2; finishedBoard++)
     {
-        if (line.empty())
-            continue;
+        game.reset();
+        applyMove(game, 4);
+        if (finishedBoard)
+            playGames(1);
+        hud.refresh(game, leaderboard, ratings, font);
+        renderFrames(30);
+        before = g_allocations.load();
+        renderFrames(600);
+        frameAllocs += g_allocations.load() - before;
+    }
 
-        // Extract name (prefer quoted)
-        string name;
-        size_t pos = 0;
-        while (pos < line.size() && isspace((unsigned char)line[pos]))
-            pos++;
-        if (pos < line.size() && line[pos] == '"')
+    cout << "Allocations: " << moveAllocs << " over 3000 games of moves, " << frameAllocs << " over 1200 steady frames\n";
+    return (moveAllocs || frameAllocs) ? 1 : 0;
+}
+#endif
+
+// ---------------- Frame export ----------------
+// Renders recorded games offscreen (renderFrame into a RenderTexture, so
+// software GL such as Mesa llvmpipe under xvfb-run works) and hands each frame
+// to a pool of PNG encoder threads through a bounded queue. The renderer only
+// blocks when every encoder is busy and the queue is full.
+class FrameEncoderPool
+{
+public:
+    struct Frame
+    {
+        Image image;
+        string path;
+    };
+
+    FrameEncoderPool(int threads, size_t capacity) : capacity(capacity)
+    {
+        for (int i = 0; i < threads; i++)
+            workers.emplace_back([this] { run(); });
+    }
+    ~FrameEncoderPool() { finish(); }
+
+    // returns the time spent waiting for queue space
+    double push(Frame&& f)
+    {
+        auto t0 = chrono::steady_clock::now();
+        unique_lock<mutex> lk(lock);
+        spaceCv.wait(lk, [this] { return frames.size() < capacity; });
+        double waited = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        frames.push_back(move(f));
+        lk.unlock();
+        workCv.notify_one();
+        return waited;
+    }
+    void finish()
+    {
         {
-            size_t endq = line.find('"', pos + 1);
-            if (endq == string::npos)
-                continue; // malformed
-            name = line.substr(pos + 1, endq - pos - 1);
-            pos = endq + 1;
+            lock_guard<mutex> lk(lock);
+            done = true;
         }
-        else
+        workCv.notify_all();
+        for (auto& w : workers)
+            w.join();
+        workers.clear();
+    }
+    uint64_t failures() const { return failed.load(); }
+
+private:
+    void run()
+    {
+        for (;;)
         {
-            // no quotes: name until first :
-            size_t comma = line.find(':', pos);
-            if (comma == string::npos)
-                continue;
-            name = line.substr(pos, comma - pos);
-            pos = comma + 1;
+            Frame f;
+            {
+                unique_lock<mutex> lk(lock);
+                workCv.wait(lk, [this] { return done || !frames.empty(); });
+                if (frames.empty())
+                    return;
+                f = move(frames.front());
+                frames.pop_front();
+            }
+            spaceCv.notify_one();
+            if (!f.image.saveToFile(f.path))
+                failed.fetch_add(1);
         }
-        // Trim name
-        while (!name.empty() && isspace((unsigned char)name.front()))
-            name.erase(name.begin());
-        while (!name.empty() && isspace((unsigned char)name.back()))
-            name.pop_back();
+    }
 
-        int wins = 0, games = 0;
+    size_t capacity;
+    vector<thread> workers;
+    mutex lock;
+    condition_variable workCv, spaceCv;
+    deque<Frame> frames;
+    bool done = false;
+    atomic<uint64_t> failed{ 0 };
+};
 
-        // Attempt to parse labeled format: look for "Wins=" and "Games="
-        size_t wpos = line.find("Wins=", pos);
-        size_t gpos = line.find("Games=", pos);
-        if (wpos != string::npos && gpos != string::npos)
+// source: a games.txt-style file, or selfplay:N for N generated games
+int runFrameExport(const string& source, const string& outDir, unsigned width, unsigned height, int fps, int encoders)
+{
+    vector<GameRecord> records;
+    if (source.rfind("selfplay:", 0) == 0)
+    {
+        int n = max(1, atoi(source.c_str() + 9));
+        for (int i = 0; i < n; i++)
         {
-            wins = parseIntAfter(line, wpos + 5);
-            games = parseIntAfter(line, gpos + 6);
+            // random mover against perfect play, alternating who starts
+            Game g;
+            g.humanVsAI = false;
+            g.player1Name = "AI (Easy)";
+            g.player2Name = "AI (Hard)";
+            g.playerFirst = i % 2 == 0;
+            g.reset();
+            while (!g.finished)
+                applyMove(g, g.turnPiece == g.player1Piece ? randomEmptyCell(g.board) : bestMoveFor(g.board, g.turnPiece));
+            GameRecord r;
+            r.player1 = g.player1Name;
+            r.player2 = g.player2Name;
+            r.player1Piece = g.player1Piece;
+            r.firstPiece = g.playerFirst ? g.player1Piece : g.player2Piece;
+            r.moves.assign(g.moves.begin(), g.moves.end());
+            records.push_back(r);
         }
-        else
+    }
+    else
+    {
+        ifstream in(source);
+        if (!in.is_open())
         {
-            // fallback: try to parse two numbers after the last quote/comma
-            // Collect all integer tokens after pos
-            vector<int> nums;
-            size_t i = pos;
-            while (i < line.size())
+            cerr << "Cannot open " << source << "\n";
+            return 1;
+        }
+        string line;
+        GameRecord r;
+        while (getline(in, line))
+            if (parseGameRecord(line, r))
+                records.push_back(r);
+    }
+    if (records.empty())
+    {
+        cerr << "No games to export\n";
+        return 1;
+    }
+
+    error_code ec;
+    filesystem::create_directories(outDir, ec);
+
+    Font font;
+    loadPreferredFont(font);
+    prewarmGlyphs(font);
+    RenderTexture target;
+    if (!target.create(width, height))
+    {
+        cerr << "Cannot create a " << width << "x" << height << " offscreen target (no GL context?)\n";
+        return 1;
+    }
+    target.setSmooth(true);
+    target.setView(View(FloatRect(0.f, 0.f, (float)WINDOW_W, (float)WINDOW_H))); // scale the UI to the output size
+    Button restartBtn = makeRestartButton();
+    Hud hud;
+    LBMap leaderboard = loadLeaderboard();
+    RatingTable ratings = loadRatings();
+
+    // each position is held for half a second, the final one for a second
+    const int holdFrames = max(1, fps / 2), finalFrames = max(1, fps);
+    uint64_t frameCount = 0;
+    double renderWait = 0;
+    auto start = chrono::steady_clock::now();
+    {
+        FrameEncoderPool pool(max(1, encoders), 4 * (size_t)max(1, encoders));
+        char name[64];
+        for (size_t gi = 0; gi < records.size(); gi++)
+        {
+            Game game;
+            startRecordedGame(records[gi], game);
+            int frameInGame = 0;
+            for (size_t step = 0; step <= records[gi].moves.size(); step++)
             {
-                // find start of number
-                while (i < line.size() && !isdigit((unsigned char)line[i]) && line[i] != '-')
-                    ++i;
-                if (i >= line.size())
-                    break;
-                size_t j = i;
-                if (line[j] == '-')
-                    ++j;
-                while (j < line.size() && isdigit((unsigned char)line[j]))
-                    ++j;
-                try
+                if (step > 0)
                 {
-                    nums.push_back(stoi(line.substr(i, j - i)));
+                    int m = records[gi].moves[step - 1];
+                    if (game.finished || game.board[m] != Piece::Empty)
+                        break; // malformed record
+                    applyMove(game, m);
                 }
-                catch (...)
+                hud.refresh(game, leaderboard, ratings, font);
+                int frames = (step == records[gi].moves.size() || game.finished) ? finalFrames : holdFrames;
+                for (int f = 0; f < frames; f++, frameInGame++)
                 {
-                    nums.push_back(0);
+                    renderFrame(target, game, hud, restartBtn, frameInGame / (float)fps, font);
+                    target.display();
+                    snprintf(name, sizeof(name), "/game%04zu_%05d.png", gi, frameInGame);
+                    renderWait += pool.push({ target.getTexture().copyToImage(), outDir + name });
+                    frameCount++;
                 }
-                i = j;
-            }
-            if (nums.size() >= 2)
-            {
-                wins = nums[0];
-                games = nums[1];
-            }
-            else if (nums.size() == 1)
-            {
-                wins = nums[0];
-                games = 0;
-            }
-            else
-            {
-                wins = 0;
-                games = 0;
+                if (game.finished)
+                    break;
             }
         }
-
-        board[name] = { wins, games };
+        pool.finish();
+        if (pool.failures())
+            cerr << pool.failures() << " frames failed to save (does " << outDir << " exist?)\n";
     }
-
-    return board;
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << fixed << setprecision(1) << "Exported " << records.size() << " games, " << frameCount << " frames at " << width
+        << "x" << height << " in " << secs << "s: " << frameCount / secs << " frames/s end to end, "
+        << frameCount / max(1e-9, secs - renderWait) << " frames/s render-side (" << renderWait << "s waiting on encoders)\n";
+    return 0;
 }
 
-static float safeWinPercent(int wins, int games)
-{
-    if (games == 0)
-        return 0.f;
-    return (100.0f * wins) / games;
-}
-void saveLeaderboard(const LBMap& board, const string& filename = "leaderboard.txt")
+// ---------------- Simul ----------------
+// One window, many classic boards against the AI. The player moves by
+// clicking a board (or, with `auto`, a random stand-in moves on every board
+// after a think time); AI replies go through the AiScheduler pool. Boards are
+// kept in a persistent canvas and only boards whose state changed are drawn
+// again: their cells and pieces go into one vertex array and their captions
+// into another that samples the font's prewarmed glyph page, so a frame is a
+// few draw calls however many boards there are.
+constexpr int SIMUL_W = 1280, SIMUL_H = 900, SIMUL_HEADER = 40, SIMUL_CAPTION = 14;
+constexpr unsigned SIMUL_GLYPHS = 16; // a size prewarmGlyphs loads, so the page never changes
+
+struct SimulLayout
 {
-    ofstream out(filename, ios::trunc);
-    if (!out.is_open())
-        return;
+    int cols = 1;
+    float pitchW = 0, pitchH = 0, size = 0; // grid pitch and board edge in pixels
 
-    for (const auto& kv : board)
+    // the column count that gives the largest boards
+    static SimulLayout fit(int boards)
     {
-        const string& name = kv.first;
-        int wins = kv.second.first;
-        int games = kv.second.second;
-        float winPercent = safeWinPercent(wins, games);
-
-        out << '"' << name << '"'
-            << ": Wins=" << wins
-            << ", Games=" << games
-            << ", Win%=" << fixed << setprecision(1) << winPercent << "%\n";
+        SimulLayout best;
+        for (int cols = 1; cols <= boards; cols++)
+        {
+            int rows = (boards + cols - 1) / cols;
+            float pw = (float)SIMUL_W / cols, ph = float(SIMUL_H - SIMUL_HEADER) / rows;
+            float size = min(pw, ph - SIMUL_CAPTION) - 6.f;
+            if (size > best.size)
+                best = { cols, pw, ph, size };
+        }
+        return best;
     }
-
-    out.close();
-}
-
-static string aiNameForDifficulty(Difficulty d)
-{
-    switch (d)
+    Vector2f topLeft(int board) const
     {
-    case Difficulty::Easy:
-        return string("AI (Easy)");
-    case Difficulty::Medium:
-        return string("AI (Medium)");
-    case Difficulty::Hard:
-        return string("AI (Hard)");
-    default:
-        return string("AI");
+        return { (board % cols) * pitchW + (pitchW - size) / 2.f, SIMUL_HEADER + (board / cols) * pitchH + 3.f };
+    }
+    // board and cell under the mouse, or -1
+    int boardAt(Vector2i mp, int boards, int& cell) const
+    {
+        if (mp.y < SIMUL_HEADER || mp.x < 0)
+            return -1;
+        int b = int((mp.y - SIMUL_HEADER) / pitchH) * cols + int(mp.x / pitchW);
+        if (b >= boards || int(mp.x / pitchW) >= cols)
+            return -1;
+        Vector2f tl = topLeft(b);
+        float lx = mp.x - tl.x, ly = mp.y - tl.y;
+        if (lx < 0 || ly < 0 || lx >= size || ly >= size)
+            return -1;
+        cell = ClassicBoard::idx(int(ly * 3 / size), int(lx * 3 / size));
+        return b;
     }
+};
+
+struct SimulBoard
+{
+    Game game;
+    bool aiPending = false;
+    bool dirty = true;
+    bool counted = false; // result added to the totals
+    uint32_t generation = 0; // bumped on restart so stale AI replies are dropped
+    float nextAt = 0;        // stand-in move or restart time, seconds since start
+};
+
+// two triangles; corners in order around the quad
+static void appendQuad(VertexArray& va, Vector2f a, Vector2f b, Vector2f c, Vector2f d, Color col)
+{
+    va.append(Vertex(a, col));
+    va.append(Vertex(b, col));
+    va.append(Vertex(c, col));
+    va.append(Vertex(a, col));
+    va.append(Vertex(c, col));
+    va.append(Vertex(d, col));
 }
 
-void updateLeaderboardOnFinish(Game& g, const string& filename = "leaderboard.txt")
+static void appendRect(VertexArray& va, float x, float y, float w, float h, Color col)
 {
-    // ensures this is only called once per finished game
-    if (g.leaderboardUpdated)
-        return;
-    LBMap board = loadLeaderboard(filename);
+    appendQuad(va, { x, y }, { x + w, y }, { x + w, y + h }, { x, y + h }, col);
+}
 
-    string name1 = g.player1Name;
-    string name2 = g.player2Name;
-    if (g.humanVsAI)
+// bar of length len and width thick centred on (cx, cy) along unit direction (dx, dy)
+static void appendBar(VertexArray& va, float cx, float cy, float dx, float dy, float len, float thick, Color col)
+{
+    float ax = dx * len / 2, ay = dy * len / 2, nx = -dy * thick / 2, ny = dx * thick / 2;
+    appendQuad(va, { cx - ax + nx, cy - ay + ny }, { cx + ax + nx, cy + ay + ny }, { cx + ax - nx, cy + ay - ny },
+        { cx - ax - nx, cy - ay - ny }, col);
+}
+
+static void appendRing(VertexArray& va, float cx, float cy, float radius, float thick, Color col)
+{
+    constexpr int SEGMENTS = 20;
+    static const array<Vector2f, SEGMENTS + 1> dirs = []
+        {
+            array<Vector2f, SEGMENTS + 1> d;
+            for (int i = 0; i <= SEGMENTS; i++)
+                d[i] = { cos(i * 6.2831853f / SEGMENTS), sin(i * 6.2831853f / SEGMENTS) };
+            return d;
+        }();
+    float ro = radius + thick / 2, ri = radius - thick / 2;
+    for (int i = 0; i < SEGMENTS; i++)
     {
-        // map AI to a specific difficulty name
-        if (name2 == "AI")
-            name2 = aiNameForDifficulty(g.difficulty);
+        Vector2f a = dirs[i], b = dirs[i + 1];
+        appendQuad(va, { cx + a.x * ro, cy + a.y * ro }, { cx + b.x * ro, cy + b.y * ro }, { cx + b.x * ri, cy + b.y * ri },
+            { cx + a.x * ri, cy + a.y * ri }, col);
     }
+}
 
-    // ensure entries exist
-    if (board.find(name1) == board.end())
-        board[name1] = { 0, 0 };
-    if (board.find(name2) == board.end())
-        board[name2] = { 0, 0 };
-
-    // increment games for both
-    board[name1].second += 1;
-    board[name2].second += 1;
-
-    // increment win for winner (if not draw)
-    if (g.winner == Piece::Empty)
+// glyph quads for s from the font page of SIMUL_GLYPHS, scaled; returns the pen position after it
+static float appendText(VertexArray& va, const Font& font, const char* s, float x, float baseline, float scale, Color col)
+{
+    for (; *s; s++)
     {
-        // draw - no wins incremented
+        const Glyph& g = font.getGlyph((Uint8)*s, SIMUL_GLYPHS, false);
+        float l = x + g.bounds.left * scale, t = baseline + g.bounds.top * scale;
+        float r = l + g.bounds.width * scale, b = t + g.bounds.height * scale;
+        float u0 = (float)g.textureRect.left, v0 = (float)g.textureRect.top;
+        float u1 = u0 + g.textureRect.width, v1 = v0 + g.textureRect.height;
+        va.append(Vertex({ l, t }, col, { u0, v0 }));
+        va.append(Vertex({ r, t }, col, { u1, v0 }));
+        va.append(Vertex({ r, b }, col, { u1, v1 }));
+        va.append(Vertex({ l, t }, col, { u0, v0 }));
+        va.append(Vertex({ r, b }, col, { u1, v1 }));
+        va.append(Vertex({ l, b }, col, { u0, v1 }));
+        x += g.advance * scale;
     }
-    else
+    return x;
+}
+
+// one board and its caption; the background covers the whole slot, so the
+// board can be drawn over its previous image
+static void appendSimulBoard(VertexArray& geo, VertexArray& text, const Font& font, const SimulBoard& sb, int index,
+    const SimulLayout& layout)
+{
+    const Game& g = sb.game;
+    Vector2f tl = layout.topLeft(index);
+    float size = layout.size, gap = max(1.f, size * 0.04f), cell = (size - 4 * gap) / 3;
+    Color frame = g.finished ? Color(68, 76, 90) : g.currentTurnIsAI ? Color(40, 44, 56) : Color(200, 180, 40);
+    appendRect(geo, (index % layout.cols) * layout.pitchW, SIMUL_HEADER + (index / layout.cols) * layout.pitchH, layout.pitchW,
+        layout.pitchH, Color(18, 20, 26));
+    appendRect(geo, tl.x - 2, tl.y - 2, size + 4, size + 4, frame);
+    appendRect(geo, tl.x, tl.y, size, size, Color(28, 30, 40));
+    float thick = max(1.5f, cell * 0.12f);
+    for (int i = 0; i < ClassicBoard::CELLS; i++)
     {
-        string winnerName = (g.winner == g.player1Piece) ? name1 : name2;
-        board[winnerName].first += 1;
+        float x = tl.x + gap + ClassicBoard::colOf(i) * (cell + gap), y = tl.y + gap + ClassicBoard::rowOf(i) * (cell + gap);
+        bool onLine = g.finished && find(g.winLine.begin(), g.winLine.end(), i) != g.winLine.end();
+        appendRect(geo, x, y, cell, cell, onLine ? Color(70, 64, 30) : Color(20, 22, 28));
+        float cx = x + cell / 2, cy = y + cell / 2;
+        if (g.board[i] == Piece::X)
+        {
+            appendBar(geo, cx, cy, 0.7071f, 0.7071f, cell * 0.75f, thick, pieceColor(Piece::X));
+            appendBar(geo, cx, cy, 0.7071f, -0.7071f, cell * 0.75f, thick, pieceColor(Piece::X));
+        }
+        else if (g.board[i] == Piece::O)
+            appendRing(geo, cx, cy, cell * 0.3f, thick, pieceColor(Piece::O));
     }
 
-    saveLeaderboard(board, filename);
-    g.leaderboardUpdated = true;
+    char caption[16];
+    const char* result = !g.finished ? "" : g.winner == Piece::Empty ? " draw" : g.winner == g.player1Piece ? " won" : " lost";
+    snprintf(caption, sizeof(caption), "%d%s", index + 1, result);
+    appendText(text, font, caption, tl.x, tl.y + size + SIMUL_CAPTION - 2, 0.7f, g.finished ? frame : Color(150, 156, 170));
 }
 
-// Helper to get string summary for a name (W/G/Win%)
-string leaderboardSummaryFor(const LBMap& board, const string& name)
+// Frame work (events to the end of drawing) and frame-to-frame interval.
+// Counts, means and maxima cover the whole run; percentiles come from the
+// last SAMPLES frames, kept in fixed rings so a long session stays bounded.
+struct SimulFrameStats
 {
-    auto it = board.find(name);
-    if (it == board.end())
-        return "0/0 (0.0%)";
-    int w = it->second.first;
-    int g = it->second.second;
-    ostringstream ss;
-    ss << w << "/" << g << " (" << fixed << setprecision(1) << safeWinPercent(w, g) << "%)";
-    return ss.str();
-}
+    static constexpr size_t RECENT = 60, SAMPLES = 1 << 14; // about 4.5 minutes at 60 fps
+    vector<float> work = vector<float>(SAMPLES), interval = vector<float>(SAMPLES); // ms, rings
+    uint64_t frames = 0, late = 0, boardsDrawn = 0;
+    double workSum = 0, workMax = 0;
 
-// ---------------- UI Helpers ----------------
-struct Button
-{
-    RectangleShape box;
-    Color baseColor, glowColor;
-    bool hovered = false;
-    int id = 0;
-    string label;
-    Button() = default;
-    Button(float x, float y, float w, float h, Color base, Color glow, int _id, const string& text = "")
-        : baseColor(base), glowColor(glow), id(_id), label(text)
+    void add(float workMs, float intervalMs)
     {
-        box.setSize(Vector2f(w, h));
-        box.setOrigin(w / 2.f, h / 2.f);
-        box.setPosition(x, y);
-        box.setFillColor(base);
-        box.setOutlineThickness(4.f);
-        box.setOutlineColor(glow);
+        work[frames % SAMPLES] = workMs;
+        interval[frames % SAMPLES] = intervalMs;
+        frames++;
+        workSum += workMs;
+        workMax = max(workMax, (double)workMs);
+        if (intervalMs > 1000.f / 60 + 2)
+            late++;
     }
-    void draw(RenderWindow& win, float t, const Font& font, int charSize = 18)
+    // mean and worst of the last second
+    void recent(const vector<float>& ring, float& avg, float& worst) const
     {
-        int alpha = 90 + int(70 * abs(sin(t * 3.5f)));
-        if (hovered)
-            box.setOutlineColor(Color(glowColor.r, glowColor.g, glowColor.b, alpha));
-        else
-            box.setOutlineColor(glowColor);
-        win.draw(box);
-        if (!label.empty())
+        size_t n = (size_t)min<uint64_t>(frames, RECENT);
+        avg = worst = 0;
+        for (size_t i = 1; i <= n; i++)
         {
-            Text txt(label, font, charSize);
-            txt.setStyle(Text::Bold);
-            FloatRect tb = txt.getLocalBounds();
-            txt.setOrigin(tb.left + tb.width / 2.f, tb.top + tb.height / 2.f);
-            txt.setPosition(box.getPosition());
-            win.draw(txt);
+            float v = ring[(frames - i) % SAMPLES];
+            avg += v / n;
+            worst = max(worst, v);
         }
     }
-    bool contains(Vector2i mp) const { return box.getGlobalBounds().contains(Vector2f((float)mp.x, (float)mp.y)); }
+    void report(ostream& os) const
+    {
+        if (frames == 0)
+            return;
+        size_t kept = (size_t)min<uint64_t>(frames, SAMPLES);
+        auto pct = [kept](const vector<float>& ring, double p)
+            {
+                vector<float> v(ring.begin(), ring.begin() + kept);
+                sort(v.begin(), v.end());
+                return v[min(v.size() - 1, (size_t)(p * v.size()))];
+            };
+        os << fixed << setprecision(2) << "Simul frames: " << frames << ", work mean " << workSum / frames << " ms, max "
+            << workMax << "; last " << kept << " frames: work p50 " << pct(work, 0.5) << " ms, p99 " << pct(work, 0.99)
+            << ", interval p50 " << pct(interval, 0.5) << " ms, p99 " << pct(interval, 0.99) << "; " << late
+            << " frames late; " << setprecision(1) << double(boardsDrawn) / frames << " boards redrawn per frame\n";
+    }
 };
 
-bool loadPreferredFont(Font& font)
+// --simul [boards] [easy|medium|hard] [auto]
+int runSimul(int boardCount, Difficulty difficulty, bool autoPlay)
 {
-    const vector<string> cand = {
-        "arial.ttf", "Arial.ttf",
-        "C:\\Windows\\Fonts\\arial.ttf",
-        "/usr/share/fonts/truetype/msttcorefonts/Arial.ttf",
-        "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf" };
-    for (auto& p : cand)
-        if (font.loadFromFile(p))
-            return true;
-    return false;
-}
+    RenderWindow window(VideoMode(SIMUL_W, SIMUL_H), "Tic-Tac-Toe Neon - Simul", Style::Close);
+    window.setFramerateLimit(60);
+    Font font;
+    if (!loadPreferredFont(font))
+        cerr << "Failed to load font\n";
+    prewarmGlyphs(font);
+    const Texture& glyphPage = font.getTexture(SIMUL_GLYPHS);
+    RenderTexture canvas;
+    if (!canvas.create(SIMUL_W, SIMUL_H))
+    {
+        cerr << "Cannot create the simul canvas\n";
+        return 1;
+    }
+    canvas.clear(Color(18, 20, 26));
 
-// drawing board pieces
-Vector2f cellTopLeft(int index)
-{
-    int r = rowOf(index), c = colOf(index);
-    float x = GAP + c * (CELL_PIX + GAP);
-    float y = BOARD_TOP + GAP + r * (CELL_PIX + GAP);
-    return { x, y };
-}
+    SimulLayout layout = SimulLayout::fit(boardCount);
+    vector<SimulBoard> boards(boardCount);
+    uniform_real_distribution<float> think(0.3f, 2.0f);
+    auto startBoard = [&](SimulBoard& b, int i, float now)
+        {
+            b.game.humanVsAI = true;
+            b.game.player1Name = "Player";
+            b.game.player2Name = "AI";
+            b.game.difficulty = difficulty;
+            b.game.playerFirst = (i + b.generation) % 2 == 0;
+            b.game.reset();
+            b.aiPending = false;
+            b.dirty = true;
+            b.counted = false;
+            b.nextAt = now + think(rng);
+        };
+    for (int i = 0; i < boardCount; i++)
+        startBoard(boards[i], i, 0);
 
-int mousePosToIndex(const Vector2i& mp)
-{
-    float boardLeft = 0.f, boardTop = BOARD_TOP + GAP;
-    if (mp.x < boardLeft + GAP || mp.x >= boardLeft + GAP + BOARD_SIZE * (CELL_PIX + GAP))
-        return -1;
-    if (mp.y < boardTop || mp.y >= boardTop + BOARD_SIZE * (CELL_PIX + GAP))
-        return -1;
-    for (int r = 0; r < BOARD_SIZE; r++)
-        for (int c = 0; c < BOARD_SIZE; c++)
+    mutex resultsMutex;
+    vector<AiResponse> pendingResults, results;
+    AiScheduler scheduler; // stopped before the vectors it fills go away
+    unsigned hw = max(1u, thread::hardware_concurrency());
+    scheduler.start((int)max(1u, hw - 1), [&](const AiResponse* r, size_t n)
         {
-            float x = GAP + c * (CELL_PIX + GAP);
-            float y = BOARD_TOP + GAP + r * (CELL_PIX + GAP);
-            if (FloatRect(x, y, CELL_PIX, CELL_PIX).contains((float)mp.x, (float)mp.y))
-                return idx(r, c);
+            lock_guard<mutex> lk(resultsMutex);
+            pendingResults.insert(pendingResults.end(), r, r + n);
+        });
+
+    VertexArray geo(Triangles), text(Triangles), headerGeo(Triangles), headerText(Triangles);
+    Sprite canvasSprite(canvas.getTexture());
+    SimulFrameStats stats;
+    int playerWins = 0, aiWins = 0, draws = 0;
+    uint64_t aiMoves = 0;
+    auto start = chrono::steady_clock::now(), lastPresent = start;
+    char header[160];
+
+    while (window.isOpen())
+    {
+        auto frameStart = chrono::steady_clock::now();
+        float now = chrono::duration<float>(frameStart - start).count();
+
+        Event ev;
+        while (window.pollEvent(ev))
+        {
+            if (ev.type == Event::Closed || (ev.type == Event::KeyPressed && ev.key.code == Keyboard::Escape))
+                window.close();
+            if (ev.type == Event::MouseButtonPressed && ev.mouseButton.button == Mouse::Left)
+            {
+                int cell = -1;
+                int i = layout.boardAt(clickPos(ev), boardCount, cell);
+                if (i < 0)
+                    continue;
+                SimulBoard& b = boards[i];
+                if (!b.game.finished && !b.game.currentTurnIsAI && b.game.board[cell] == Piece::Empty)
+                {
+                    applyMove(b.game, cell);
+                    b.dirty = true;
+                }
+            }
         }
-    return -1;
-}
 
-void drawCellBackground(RenderWindow& win, float x, float y, float w, float h, const Color& fill, const Color& outline, float outlineThickness = 3.f)
-{
-    RectangleShape rect(Vector2f(w, h));
-    rect.setPosition(x, y);
-    rect.setFillColor(fill);
-    rect.setOutlineThickness(outlineThickness);
-    rect.setOutlineColor(outline);
-    win.draw(rect);
+        {
+            lock_guard<mutex> lk(resultsMutex);
+            results.swap(pendingResults);
+        }
+        for (const AiResponse& r : results)
+        {
+            SimulBoard& b = boards[(uint32_t)r.tag];
+            if ((uint32_t)(r.tag >> 32) != b.generation || !b.aiPending)
+                continue;
+            b.aiPending = false;
+            if (r.move >= 0 && b.game.board[r.move] == Piece::Empty)
+            {
+                applyMove(b.game, r.move);
+                aiMoves++;
+            }
+            b.nextAt = now + think(rng);
+            b.dirty = true;
+        }
+        results.clear();
+
+        for (int i = 0; i < boardCount; i++)
+        {
+            SimulBoard& b = boards[i];
+            Game& g = b.game;
+            if (g.finished)
+            {
+                if (!b.counted)
+                {
+                    (g.winner == Piece::Empty ? draws : g.winner == g.player1Piece ? playerWins : aiWins)++;
+                    b.counted = true;
+                    b.nextAt = now + 3.f; // show the result, then play again
+                }
+                else if (now >= b.nextAt)
+                {
+                    b.generation++;
+                    startBoard(b, i, now);
+                }
+            }
+            else if (g.currentTurnIsAI)
+            {
+                if (!b.aiPending)
+                {
+                    AiRequest r;
+                    r.tag = (uint64_t)b.generation << 32 | (uint32_t)i;
+                    r.board = g.board;
+                    r.aiPiece = g.player2Piece;
+                    r.difficulty = difficulty;
+                    b.aiPending = scheduler.submit(r, 50000); // a full queue is retried next frame
+                }
+            }
+            else if (autoPlay && now >= b.nextAt)
+            {
+                applyMove(g, randomEmptyCell(g.board));
+                b.dirty = true;
+            }
+        }
+
+        // boards that changed, into the canvas: two draw calls however many there are
+        geo.clear();
+        text.clear();
+        int drawn = 0;
+        for (int i = 0; i < boardCount; i++)
+            if (boards[i].dirty)
+            {
+                appendSimulBoard(geo, text, font, boards[i], i, layout);
+                boards[i].dirty = false;
+                drawn++;
+            }
+        if (drawn)
+        {
+            canvas.draw(geo);
+            canvas.draw(text, RenderStates(&glyphPage));
+            canvas.display();
+        }
+        stats.boardsDrawn += drawn;
+
+        float workAvg, workWorst, intervalAvg, intervalWorst;
+        stats.recent(stats.work, workAvg, workWorst);
+        stats.recent(stats.interval, intervalAvg, intervalWorst);
+        snprintf(header, sizeof(header),
+            "Simul: %d boards   Player %d  AI %d  draws %d   frame %.2f ms (worst %.2f)   %.1f fps   redrawn %d", boardCount,
+            playerWins, aiWins, draws, workAvg, workWorst, intervalAvg > 0 ? 1000.f / intervalAvg : 0.f, drawn);
+        headerGeo.clear();
+        headerText.clear();
+        appendRect(headerGeo, 0, 0, (float)SIMUL_W, (float)SIMUL_HEADER, Color(28, 30, 40));
+        appendText(headerText, font, header, 12, SIMUL_HEADER / 2.f + 6, 1.f, Color::White);
+
+        window.draw(canvasSprite);
+        window.draw(headerGeo);
+        window.draw(headerText, RenderStates(&glyphPage));
+        auto workEnd = chrono::steady_clock::now();
+        window.display();
+        auto presented = chrono::steady_clock::now();
+        stats.add(chrono::duration<float, milli>(workEnd - frameStart).count(),
+            chrono::duration<float, milli>(presented - lastPresent).count());
+        lastPresent = presented;
+    }
+
+    scheduler.stop();
+    stats.report(cout);
+    cout << "Games: player " << playerWins << ", AI " << aiWins << ", draws " << draws << "; " << aiMoves << " AI moves\n";
+    AiScheduler::printMetrics(scheduler.metrics(), cout);
+    return 0;
 }
 
-void drawX(RenderWindow& win, float cx, float cy, float size, Color color, float time, bool pulse)
+// ---------------- Perft ----------------
+// Counts every legal move sequence from a position, split by how it ends, to
+// serve as a correctness oracle and a move-generation benchmark. X moves
+// first; positions are X/O masks with X to move when the counts are equal.
+struct PerftCounts
 {
-    if (pulse)
+    uint64_t nodes = 0, xWins = 0, oWins = 0, draws = 0, unfinished = 0;
+    uint64_t games() const { return xWins + oWins + draws; }
+    PerftCounts& operator+=(const PerftCounts& o)
     {
-        int alpha = 100 + int(120 * abs(sin(time * 4.f)));
-        RectangleShape g1(Vector2f(size, 16)), g2(Vector2f(size, 16));
-        g1.setOrigin(size / 2, 8);
-        g2.setOrigin(size / 2, 8);
-        g1.setPosition(cx, cy);
-        g2.setPosition(cx, cy);
-        g1.setRotation(45);
-        g2.setRotation(-45);
-        g1.setFillColor(Color(color.r, color.g, color.b, alpha));
-        g2.setFillColor(Color(color.r, color.g, color.b, alpha));
-        win.draw(g1);
-        win.draw(g2);
+        nodes += o.nodes;
+        xWins += o.xWins;
+        oWins += o.oWins;
+        draws += o.draws;
+        unfinished += o.unfinished;
+        return *this;
     }
-    RectangleShape r1(Vector2f(size, 10)), r2(Vector2f(size, 10));
-    r1.setOrigin(size / 2, 5);
-    r2.setOrigin(size / 2, 5);
-    r1.setPosition(cx, cy);
-    r2.setPosition(cx, cy);
-    r1.setRotation(45);
-    r2.setRotation(-45);
-    r1.setFillColor(color);
-    r2.setFillColor(color);
-    win.draw(r1);
-    win.draw(r2);
-}
+    bool operator==(const PerftCounts& o) const
+    {
+        return nodes == o.nodes && xWins == o.xWins && oWins == o.oWins && draws == o.draws && unfinished == o.unfinished;
+    }
+};
 
-void drawO(RenderWindow& win, float cx, float cy, float size, Color color, float time, bool pulse)
+class Perft
 {
-    if (pulse)
+public:
+    Perft(const Variant& v, bool dedup) : v(v), dedup(dedup), full((1u << v.cells) - 1) {}
+
+    // the position itself is counted as a node; `depth` plies below it
+    PerftCounts run(uint32_t x, uint32_t o, int depth)
     {
-        CircleShape glow(size / 2 + 8);
-        glow.setOrigin(size / 2 + 8, size / 2 + 8);
-        glow.setPosition(cx, cy);
-        int alpha = 100 + int(110 * abs(sin(time * 4.f)));
-        glow.setFillColor(Color(color.r, color.g, color.b, alpha));
-        win.draw(glow);
+        if (!dedup)
+        {
+            PerftCounts c;
+            c.nodes = 1;
+            walk(x, o, depth, c);
+            return c;
+        }
+        return memo(x, o, depth);
     }
-    CircleShape circ(size / 2 - 8);
-    circ.setOrigin(size / 2 - 8, size / 2 - 8);
-    circ.setPosition(cx, cy);
-    circ.setFillColor(Color::Transparent);
-    circ.setOutlineThickness(10);
-    circ.setOutlineColor(color);
-    win.draw(circ);
-}
+    size_t uniquePositions() const { return table.size(); }
 
-void renderBoard(RenderWindow& win, const Game& g, float time, const Font& font)
-{
-    RectangleShape bg(Vector2f(WINDOW_W, WINDOW_H));
-    bg.setFillColor(Color(28, 30, 40));
-    win.draw(bg);
-    for (int i = 0; i < 9; i++)
+private:
+    void walk(uint32_t x, uint32_t o, int depth, PerftCounts& c)
     {
-        Vector2f tl = cellTopLeft(i);
-        drawCellBackground(win, tl.x, tl.y, (float)CELL_PIX, (float)CELL_PIX, Color(20, 22, 28), Color(68, 76, 90), 3.f);
-        float cx = tl.x + CELL_PIX / 2.f, cy = tl.y + CELL_PIX / 2.f;
-        bool pulse = (g.finished && find(g.winLine.begin(), g.winLine.end(), i) != g.winLine.end());
-        if (g.board[i] == Piece::X)
-            drawX(win, cx, cy, CELL_PIX * 0.6f, Color(255, 120, 110), time, pulse);
-        else if (g.board[i] == Piece::O)
-            drawO(win, cx, cy, CELL_PIX * 0.6f, Color(110, 190, 255), time, pulse);
+        if (depth == 0)
+        {
+            c.unfinished++;
+            return;
+        }
+        bool xToMove = popCount32(x) == popCount32(o);
+        for (uint32_t e = full & ~(x | o); e; e &= e - 1)
+        {
+            int cell = lowestBit32(e);
+            uint32_t bit = 1u << cell;
+            uint32_t nx = xToMove ? x | bit : x, no = xToMove ? o : o | bit;
+            c.nodes++;
+            if (completesLine(v, xToMove ? nx : no, cell))
+                (xToMove ? c.xWins : c.oWins)++;
+            else if ((nx | no) == full)
+                c.draws++;
+            else
+                walk(nx, no, depth - 1, c);
+        }
     }
-    RectangleShape footer(Vector2f(WINDOW_W, FOOTER_H));
-    footer.setPosition(0, BOARD_TOP + GAP + BOARD_SIZE * (CELL_PIX + GAP));
-    footer.setFillColor(Color(18, 20, 26));
-    win.draw(footer);
 
-    // If finished draw result text in footer
-    Text res("", font, 20);
-    res.setFillColor(Color::White);
-    if (g.finished)
+    PerftCounts memo(uint32_t x, uint32_t o, int depth)
     {
-        res.setString("Click to play again");
-        FloatRect r = res.getLocalBounds();
-        res.setPosition((WINDOW_W - r.width) / 2.f, footer.getPosition().y + 10);
-        win.draw(res);
+        uint64_t key = (uint64_t)x | (uint64_t)o << 25 | (uint64_t)depth << 50;
+        auto it = table.find(key);
+        if (it != table.end())
+            return it->second;
+        PerftCounts c;
+        c.nodes = 1;
+        if (depth == 0)
+            c.unfinished = 1;
+        else
+        {
+            bool xToMove = popCount32(x) == popCount32(o);
+            for (uint32_t e = full & ~(x | o); e; e &= e - 1)
+            {
+                int cell = lowestBit32(e);
+                uint32_t bit = 1u << cell;
+                uint32_t nx = xToMove ? x | bit : x, no = xToMove ? o : o | bit;
+                if (completesLine(v, xToMove ? nx : no, cell))
+                {
+                    c.nodes++;
+                    (xToMove ? c.xWins : c.oWins)++;
+                }
+                else if ((nx | no) == full)
+                {
+                    c.nodes++;
+                    c.draws++;
+                }
+                else
+                    c += memo(nx, no, depth - 1);
+            }
+        }
+        table[key] = c;
+        return c;
     }
-}
 
-// ---------------- Menus (blocking loops) ----------------
-int playerTypeMenu(RenderWindow& win, const Font& font)
+    const Variant& v;
+    bool dedup;
+    uint32_t full;
+    unordered_map<uint64_t, PerftCounts> table;
+};
+
+// Same count for the 3x3 game driven through the live Game/checkFinish code.
+void perftThroughEngine(Game& g, int depth, PerftCounts& c)
 {
-    vector<Button> btns;
-    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f - 60, 300, 90, Color(30, 30, 40), Color(0, 180, 255), 1, "Human vs Human");
-    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f + 60, 300, 90, Color(30, 30, 40), Color(255, 100, 100), 2, "Human vs AI");
-    Clock clock;
-    while (win.isOpen())
+    if (depth == 0)
     {
-        Event ev;
-        while (win.pollEvent(ev))
+        c.unfinished++;
+        return;
+    }
+    Piece mover = g.turnPiece;
+    for (int i = 0; i < ClassicBoard::CELLS; i++)
+        if (g.board[i] == Piece::Empty)
         {
-            if (ev.type == Event::Closed)
-                win.close();
-            if (ev.type == Event::MouseButtonPressed && ev.mouseButton.button == Mouse::Left)
+            g.board[i] = mover;
+            checkFinish(g);
+            c.nodes++;
+            if (g.finished)
             {
-                Vector2i mp = Mouse::getPosition(win);
-                for (auto& b : btns)
-                    if (b.contains(mp))
-                        return b.id;
+                if (g.winner == Piece::X)
+                    c.xWins++;
+                else if (g.winner == Piece::O)
+                    c.oWins++;
+                else
+                    c.draws++;
+            }
+            else
+            {
+                g.turnPiece = (mover == Piece::X) ? Piece::O : Piece::X;
+                perftThroughEngine(g, depth - 1, c);
+                g.turnPiece = mover;
             }
+            g.board[i] = Piece::Empty;
+            g.finished = false;
+            g.winner = Piece::Empty;
+        }
+}
+
+// "X.O..." row-major (or "-" for the empty board) into X/O masks; false with
+// a message if it isn't a reachable, unfinished position
+bool parsePosition(const Variant& v, const string& position, uint32_t& x, uint32_t& o)
+{
+    x = o = 0;
+    if (!position.empty() && position != "-")
+    {
+        if ((int)position.size() != v.cells)
+        {
+            cerr << "Position needs " << v.cells << " characters of X, O and .\n";
+            return false;
+        }
+        for (int i = 0; i < v.cells; i++)
+        {
+            char ch = (char)toupper((unsigned char)position[i]);
+            if (ch == 'X')
+                x |= 1u << i;
+            else if (ch == 'O')
+                o |= 1u << i;
         }
-        Vector2i mp = Mouse::getPosition(win);
-        for (auto& b : btns)
-            b.hovered = b.contains(mp);
-        float t = clock.getElapsedTime().asSeconds();
-        win.clear(Color(20, 22, 28));
-        for (auto& b : btns)
-            b.draw(win, t, font, 20);
-        win.display();
     }
-    return 1;
+    int xs = popCount32(x), os = popCount32(o);
+    if ((xs != os && xs != os + 1) || hasLine(v, x) || hasLine(v, o))
+    {
+        cerr << "Not a reachable, unfinished position with X moving first\n";
+        return false;
+    }
+    return true;
 }
 
-Piece symbolMenu(RenderWindow& win, const Font& font)
+int runPerft(int n, int k, int depth, const string& position, int threads, bool dedup)
 {
-    vector<Button> btns;
-    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f - 60, 200, 80, Color(30, 30, 40), Color(255, 100, 100), 1, "Play as X");
-    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f + 60, 200, 80, Color(30, 30, 40), Color(100, 255, 100), 2, "Play as O");
-    Clock clock;
-    while (win.isOpen())
+    Variant v = makeVariant(n, k);
+    uint32_t x, o;
+    if (!parsePosition(v, position, x, o))
+        return 1;
+    int xs = popCount32(x), os = popCount32(o);
+    if (depth <= 0 || depth > v.cells - xs - os)
+        depth = v.cells - xs - os;
+
+    // split the tree two plies down so threads get even shares
+    struct Task
     {
-        Event ev;
-        while (win.pollEvent(ev))
+        uint32_t x, o;
+        int depth;
+    };
+    vector<Task> tasks;
+    PerftCounts top;
+    top.nodes = 1;
+    function<void(uint32_t, uint32_t, int, int)> split = [&](uint32_t px, uint32_t po, int d, int levels)
         {
-            if (ev.type == Event::Closed)
-                win.close();
-            if (ev.type == Event::MouseButtonPressed && ev.mouseButton.button == Mouse::Left)
+            if (levels == 0 || d == 0)
             {
-                Vector2i mp = Mouse::getPosition(win);
-                for (auto& b : btns)
-                    if (b.contains(mp))
-                        return (b.id == 1) ? Piece::X : Piece::O;
+                tasks.push_back({ px, po, d });
+                return;
+            }
+            bool xToMove = popCount32(px) == popCount32(po);
+            uint32_t full = (1u << v.cells) - 1;
+            for (uint32_t e = full & ~(px | po); e; e &= e - 1)
+            {
+                int cell = lowestBit32(e);
+                uint32_t nx = xToMove ? px | (1u << cell) : px, no = xToMove ? po : po | (1u << cell);
+                top.nodes++;
+                if (completesLine(v, xToMove ? nx : no, cell))
+                    (xToMove ? top.xWins : top.oWins)++;
+                else if ((nx | no) == full)
+                    top.draws++;
+                else
+                    split(nx, no, d - 1, levels - 1);
+            }
+        };
+    split(x, o, depth, 2);
+
+    atomic<size_t> next{ 0 };
+    vector<PerftCounts> perThread(max(1, threads));
+    vector<size_t> unique(perThread.size());
+    auto start = chrono::steady_clock::now();
+    auto worker = [&](int id)
+        {
+            Perft p(v, dedup);
+            size_t i;
+            while ((i = next.fetch_add(1)) < tasks.size())
+            {
+                PerftCounts c = p.run(tasks[i].x, tasks[i].o, tasks[i].depth);
+                c.nodes--; // the task root is already in `top`
+                perThread[id] += c;
             }
+            unique[id] = p.uniquePositions();
+        };
+    vector<thread> pool;
+    for (int t = 1; t < (int)perThread.size(); t++)
+        pool.emplace_back(worker, t);
+    worker(0);
+    for (auto& th : pool)
+        th.join();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    PerftCounts total = top;
+    for (auto& c : perThread)
+        total += c;
+    cout << n << "x" << n << " k=" << k << " depth " << depth << (dedup ? " (transpositions merged per thread)" : "") << ":\n"
+        << "  nodes " << total.nodes << ", games " << total.games() << " (X wins " << total.xWins << ", O wins " << total.oWins
+        << ", draws " << total.draws << "), unfinished at depth " << total.unfinished << "\n"
+        << fixed << setprecision(3) << "  " << secs << "s on " << perThread.size() << " threads, " << setprecision(1)
+        << total.nodes / max(secs, 1e-9) / 1e6 << " M nodes/s";
+    if (dedup)
+    {
+        size_t u = 0;
+        for (size_t c : unique)
+            u += c;
+        cout << ", " << u << " positions expanded";
+    }
+    cout << "\n";
+
+    int status = 0;
+    if (n == BOARD_SIZE && k == WIN_LENGTH)
+    {
+        // the live engine has to agree on the same position
+        Game g;
+        g.humanVsAI = false;
+        g.reset();
+        for (int i = 0; i < ClassicBoard::CELLS; i++)
+            g.board[i] = (x >> i & 1) ? Piece::X : (o >> i & 1) ? Piece::O : Piece::Empty;
+        g.turnPiece = (xs == os) ? Piece::X : Piece::O;
+        PerftCounts engine;
+        engine.nodes = 1;
+        perftThroughEngine(g, depth, engine);
+        bool agree = engine == total;
+        cout << "  checkFinish engine " << (agree ? "agrees" : "DISAGREES") << " (" << engine.games() << " games)\n";
+        if (!agree)
+            status = 1;
+        if (x == 0 && o == 0 && depth == 9)
+        {
+            bool known = total.games() == 255168 && total.xWins == 131184 && total.oWins == 77904 && total.draws == 46080;
+            cout << "  known 3x3 totals (255168 games: 131184 / 77904 / 46080) " << (known ? "reproduced" : "NOT reproduced") << "\n";
+            if (!known)
+                status = 1;
         }
-        Vector2i mp = Mouse::getPosition(win);
-        for (auto& b : btns)
-            b.hovered = b.contains(mp);
-        float t = clock.getElapsedTime().asSeconds();
-        win.clear(Color(20, 22, 28));
-        for (auto& b : btns)
-            b.draw(win, t, font, 20);
-        win.display();
     }
-    return Piece::X;
+    return status;
 }
 
-bool firstTurnMenu(RenderWindow& win, const Font& font, const string& p1, const string& p2, bool vsAI)
+// ---------------- Transposition table benchmark ----------------
+// Solves one position four ways to show what the shared table saves: no
+// table, one thread with a table, and `threads` threads with private tables
+// (the same total memory) versus one shared table. With an endgame table for
+// the variant on disk, the shared-table run is repeated probing it.
+int runTTBenchmark(int n, int k, size_t megabytes, int threads, const string& position)
 {
-    vector<Button> btns;
-    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f - 60, 260, 80, Color(30, 30, 40), Color(255, 200, 0), 1, p1 + " first");
-    string secondLabel = vsAI ? "AI first" : p2 + " first";
-    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f + 60, 260, 80, Color(30, 30, 40), Color(255, 0, 100), 2, secondLabel);
-    Clock clock;
-    while (win.isOpen())
+    Variant v = makeVariant(n, k);
+    uint32_t x, o;
+    if (!parsePosition(v, position, x, o))
+        return 1;
+    threads = max(1, threads);
+    bool xToMove = popCount32(x) == popCount32(o);
+    cout << n << "x" << n << " k=" << k << ", " << megabytes << " MB table, " << threads << " threads\n";
+
+    uint64_t baseline = 0;
+    int status = 0, expected = INT32_MIN;
+    auto run = [&](const char* label, const vector<TranspositionTable*>& tables, int t, const EndgameTable* eg = nullptr)
+        {
+            auto start = chrono::steady_clock::now();
+            SolveResult r = solvePosition(v, x, o, tables, t, eg);
+            double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (!baseline)
+                baseline = r.nodes;
+            if (expected == INT32_MIN)
+                expected = r.score;
+            else if (r.score != expected)
+                status = 1;
+            string value = r.score == 0 ? "draw"
+                : (r.score > 0 ? string(xToMove ? "X" : "O") + " wins in " + to_string(TTSearch::WIN - r.score)
+                    : string(xToMove ? "O" : "X") + " wins in " + to_string(TTSearch::WIN + r.score));
+            cout << "  " << left << setw(22) << label << right << setw(12) << r.nodes << " nodes"
+                << fixed << setprecision(1) << setw(7) << 100.0 * r.nodes / baseline << "%" << setprecision(3) << setw(9)
+                << secs << "s  " << value << ", move " << r.move;
+            if (r.stats.probes)
+                cout << setprecision(1) << "  | hits " << 100.0 * r.stats.hits / r.stats.probes << "%, collisions "
+                    << r.stats.collisions << ", overwrites " << r.stats.overwrites;
+            cout << (r.score != expected ? "  VALUE DIFFERS" : "") << "\n";
+        };
+
+    run("no table, 1 thread", {}, 1);
+    TranspositionTable shared(megabytes);
+    run("table, 1 thread", { &shared }, 1);
+    if (threads > 1)
     {
-        Event ev;
-        while (win.pollEvent(ev))
+        vector<unique_ptr<TranspositionTable>> owned;
+        vector<TranspositionTable*> privateTables;
+        for (int t = 0; t < threads; t++)
         {
-            if (ev.type == Event::Closed)
-                win.close();
-            if (ev.type == Event::MouseButtonPressed && ev.mouseButton.button == Mouse::Left)
-            {
-                Vector2i mp = Mouse::getPosition(win);
-                for (auto& b : btns)
-                    if (b.contains(mp))
-                        return b.id == 1;
-            }
+            owned.emplace_back(new TranspositionTable(max<size_t>(1, megabytes / threads)));
+            privateTables.push_back(owned.back().get());
         }
-        Vector2i mp = Mouse::getPosition(win);
-        for (auto& b : btns)
-            b.hovered = b.contains(mp);
-        float t = clock.getElapsedTime().asSeconds();
-        win.clear(Color(20, 22, 28));
-        for (auto& b : btns)
-            b.draw(win, t, font, 18);
-        win.display();
+        run("private tables", privateTables, threads);
+        TranspositionTable fresh(megabytes);
+        run("shared table", { &fresh }, threads);
     }
-    return true;
+
+    // cross-check against the endgame table when one is on disk, then let the
+    // search probe it
+    EndgameTable eg;
+    if (eg.open(endgameFileName(n, k)) && eg.covers(n, k))
+    {
+        TranspositionTable probed(megabytes);
+        run("shared + endgame", { &probed }, threads, &eg);
+        int want = egScore(eg.probe(xToMove ? x : o, xToMove ? o : x));
+        cout << "  endgame table " << (want == expected ? "agrees" : "DISAGREES") << "\n";
+        if (want != expected)
+            status = 1;
+    }
+    return status;
 }
 
-Difficulty aiDifficultyMenu(RenderWindow& win, const Font& font)
+// ---------------- Board benchmark ----------------
+// --board-bench: Board<N, K> against the runtime code it can replace. Win
+// checks race evaluateBoard's cell-by-cell walk on the array board and
+// Variant's mask list; the full 3x3 tree races minimax; every reachable 3x3 position is
+// searched both ways and reduced by the generated symmetries as a check.
+template <class F>
+static double nsPerPosition(size_t count, int rounds, long& found, F&& check)
 {
-    vector<Button> btns;
-    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f - 80, 220, 70, Color(30, 30, 40), Color(200, 200, 200), 1, "Easy");
-    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f, 220, 70, Color(30, 30, 40), Color(100, 255, 100), 2, "Medium");
-    btns.emplace_back(WINDOW_W / 2.f, WINDOW_H / 2.f + 80, 220, 70, Color(30, 30, 40), Color(255, 100, 100), 3, "Hard");
-    Clock clock;
-    while (win.isOpen())
+    found = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (size_t i = 0; i < count; i++)
+            found += check(i);
+    found /= rounds;
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count() / (double(count) * rounds);
+}
+
+template <int N, int K>
+static void benchWinChecks(size_t count, int rounds)
+{
+    using B = Board<N, K>;
+    Variant v = makeVariant(N, K);
+    vector<uint32_t> xs(count), os(count);
+    vector<array<Piece, ClassicBoard::CELLS>> arrays(N == 3 ? count : 0);
+    for (size_t i = 0; i < count; i++)
     {
-        Event ev;
-        while (win.pollEvent(ev))
+        // a random number of stones, X and O alternating, on random cells
+        uint32_t x = 0, o = 0;
+        int stones = uniform_int_distribution<int>(0, B::CELLS)(rng);
+        for (int s = 0; s < stones; s++)
         {
-            if (ev.type == Event::Closed)
-                win.close();
-            if (ev.type == Event::MouseButtonPressed && ev.mouseButton.button == Mouse::Left)
-            {
-                Vector2i mp = Mouse::getPosition(win);
-                for (auto& b : btns)
-                    if (b.contains(mp))
-                        return (b.id == 1) ? Difficulty::Easy : (b.id == 2) ? Difficulty::Medium
-                        : Difficulty::Hard;
-            }
+            int c;
+            do
+                c = uniform_int_distribution<int>(0, B::CELLS - 1)(rng);
+            while (((x | o) >> c) & 1);
+            (s % 2 ? o : x) |= 1u << c;
         }
-        Vector2i mp = Mouse::getPosition(win);
-        for (auto& b : btns)
-            b.hovered = b.contains(mp);
-        float t = clock.getElapsedTime().asSeconds();
-        win.clear(Color(20, 22, 28));
-        for (auto& b : btns)
-            b.draw(win, t, font, 18);
-        win.display();
+        xs[i] = x;
+        os[i] = o;
+        if (N == 3)
+            for (int c = 0; c < ClassicBoard::CELLS; c++)
+                arrays[i][c] = (x >> c & 1) ? Piece::X : (o >> c & 1) ? Piece::O : Piece::Empty;
     }
-    return Difficulty::Medium;
+    long found;
+    cout << "  " << N << "x" << N << " k" << K << ":";
+    if (N == 3)
+    {
+        double ns = nsPerPosition(count, rounds, found, [&](size_t i) { return evaluateBoard(arrays[i], Piece::X) != 0; });
+        cout << " line walk " << setprecision(2) << ns << " ns (" << found << " wins),";
+    }
+    double ns = nsPerPosition(count, rounds, found, [&](size_t i) { return hasLine(v, xs[i]) || hasLine(v, os[i]); });
+    cout << " Variant " << ns << " ns (" << found << "),";
+    ns = nsPerPosition(count, rounds, found, [&](size_t i) { return B::hasLine(xs[i]) || B::hasLine(os[i]); });
+    cout << " Board<" << N << ", " << K << "> " << ns << " ns (" << found << ")\n";
 }
 
-// Name input with event handling (Enter confirms)
-string nameInput(RenderWindow& win, const Font& font, const string& prompt)
+int runBoardBenchmark()
 {
-    RectangleShape box(Vector2f(360.f, 52.f));
-    box.setOrigin(box.getSize().x / 2.f, box.getSize().y / 2.f);
-    box.setPosition(WINDOW_W / 2.f, WINDOW_H / 2.f + 10);
-    box.setFillColor(Color::Transparent);
-    box.setOutlineThickness(2.f);
-    string s;
-    bool done = false;
-    Clock clock;
-    while (win.isOpen() && !done)
-    {
-        Event ev;
-        while (win.pollEvent(ev))
+    cout << fixed << "Win checks per position:\n";
+    benchWinChecks<3, 3>(1 << 16, 100);
+    benchWinChecks<4, 4>(1 << 16, 100);
+    benchWinChecks<5, 4>(1 << 16, 100);
+
+    // the whole tree from the empty board, once per root move
+    array<Piece, ClassicBoard::CELLS> empty;
+    empty.fill(Piece::Empty);
+    const int rounds = 5;
+    array<int, 9> arrayValues{}, maskValues{};
+    auto t0 = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < ClassicBoard::CELLS; i++)
         {
-            if (ev.type == Event::Closed)
-            {
-                win.close();
-                done = true;
-                break;
-            }
-            if (ev.type == Event::TextEntered)
-            {
-                uint32_t c = ev.text.unicode;
-                if (c == 13)
-                { // Enter
-                    if (!s.empty())
-                        done = true;
-                }
-                else if (c == 8)
-                { // backspace
-                    if (!s.empty())
-                        s.pop_back();
+            empty[i] = Piece::X;
+            arrayValues[i] = minimax(empty, false, -10000, 10000, Piece::X);
+            empty[i] = Piece::Empty;
+        }
+    auto t1 = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < ClassicBoard::CELLS; i++)
+            maskValues[i] = boardMinimax<ClassicBoard>(1u << i, 0, false, -10000, 10000);
+    auto t2 = chrono::steady_clock::now();
+    double arrayMs = chrono::duration<double, milli>(t1 - t0).count() / rounds;
+    double maskMs = chrono::duration<double, milli>(t2 - t1).count() / rounds;
+    cout << setprecision(3) << "Empty 3x3 board, all nine replies searched: minimax " << arrayMs << " ms, Board<3, 3> "
+        << maskMs << " ms (" << setprecision(1) << arrayMs / max(maskMs, 1e-9) << "x); values "
+        << (arrayValues == maskValues ? "agree" : "DIFFER") << "\n";
+
+    // every reachable position: best moves both ways, hint values against
+    // Board<3, 3>, and symmetry classes
+    vector<uint64_t> positions, classes;
+    int differ = 0, hintsDiffer = 0;
+    HintAnalyzer hints;
+    Game hintGame;
+    function<void(uint32_t, uint32_t, bool)> walk = [&](uint32_t x, uint32_t o, bool xToMove)
+        {
+            positions.push_back((uint64_t)x << 32 | o);
+            classes.push_back(ClassicBoard::canonical(x, o));
+            if (ClassicBoard::hasLine(x) || ClassicBoard::hasLine(o) || (x | o) == ClassicBoard::FULL)
+                return;
+            array<Piece, ClassicBoard::CELLS> b;
+            for (int c = 0; c < ClassicBoard::CELLS; c++)
+                b[c] = (x >> c & 1) ? Piece::X : (o >> c & 1) ? Piece::O : Piece::Empty;
+            Piece me = xToMove ? Piece::X : Piece::O;
+            int reference = -1, bestVal = -10000;
+            for (int i = 0; i < ClassicBoard::CELLS; i++)
+                if (b[i] == Piece::Empty)
+                {
+                    b[i] = me;
+                    int val = minimax(b, false, -10000, 10000, me);
+                    b[i] = Piece::Empty;
+                    if (val > bestVal)
+                    {
+                        bestVal = val;
+                        reference = i;
+                    }
                 }
-                else if (c >= 32 && c < 127 && s.size() < 32)
+            if (bestMoveFor(b, me) != reference)
+                differ++;
+            hintGame.board = b;
+            hintGame.turnPiece = me;
+            const CellHints& h = hints.update(hintGame, 1e9);
+            uint32_t mine = xToMove ? x : o, theirs = xToMove ? o : x;
+            for (uint32_t e = ClassicBoard::FULL & ~(x | o); e; e &= e - 1)
+            {
+                int c = lowestBit32(e);
+                uint32_t played = mine | (1u << c);
+                int val = ClassicBoard::completesLine(played, c) ? 10 : boardMinimax<ClassicBoard>(played, theirs, false, -10000, 10000);
+                int hint = h.score[c];
+                if (!h.complete || (val > 0) != (hint > 0) || (val < 0) != (hint < 0))
                 {
-                    s.push_back((char)c);
+                    hintsDiffer++;
+                    break;
                 }
             }
-            if (ev.type == Event::KeyPressed && ev.key.code == Keyboard::Enter)
+            for (uint32_t e = ClassicBoard::FULL & ~(x | o); e; e &= e - 1)
             {
-                if (!s.empty())
-                    done = true;
+                uint32_t bit = e & (0u - e);
+                if (xToMove)
+                    walk(x | bit, o, false);
+                else
+                    walk(x, o | bit, true);
             }
-        }
-        float t = clock.getElapsedTime().asSeconds();
-        box.setOutlineColor(Color::White);
-        win.clear(Color(20, 22, 28));
-        Text p(prompt, font, 20);
-        p.setFillColor(Color::White);
-        p.setPosition(WINDOW_W / 2.f - 180, WINDOW_H / 2.f - 40);
-        win.draw(p);
-        win.draw(box);
-        Text txt(s.empty() ? string("> ") : s, font, 20);
-        txt.setFillColor(Color::White);
-        txt.setPosition(box.getPosition().x - box.getSize().x / 2.f + 8, box.getPosition().y - box.getSize().y / 2.f + 8);
-        win.draw(txt);
-        win.display();
-    }
-    return s.empty() ? "Player" : s;
+        };
+    walk(0, 0, true);
+    auto distinct = [](vector<uint64_t>& v)
+        {
+            sort(v.begin(), v.end());
+            return size_t(unique(v.begin(), v.end()) - v.begin());
+        };
+    cout << "Reachable 3x3 positions: " << distinct(positions) << ", " << distinct(classes) << " up to symmetry; best moves differ on "
+        << differ << " of " << positions.size() << " visits; hints differ from Board<3, 3> on " << hintsDiffer << "\n";
+    return (arrayValues == maskValues && differ == 0 && hintsDiffer == 0) ? 0 : 1;
 }
 
-int main()
+int main(int argc, char** argv)
 {
+#if defined(TTT_ALLOC_CHECK)
+    if (argc >= 2 && string(argv[1]) == "--alloc-check")
+        return runAllocationCheck();
+#endif
+    // Offline tools: --gen-endgame N K [file] [threads]
+    if (argc >= 4 && string(argv[1]) == "--gen-endgame")
+    {
+        int n = atoi(argv[2]), k = atoi(argv[3]);
+        if (n < 3 || n > 5 || k < 3 || k > n)
+        {
+            cerr << "Usage: " << argv[0] << " --gen-endgame N K [file] [threads]  (3 <= K <= N <= 5)\n";
+            return 1;
+        }
+        string file = argc >= 5 ? argv[4] : endgameFileName(n, k);
+        int threads = argc >= 6 ? atoi(argv[5]) : (int)max(1u, thread::hardware_concurrency());
+        return generateEndgameTable(makeVariant(n, k), file, max(1, threads)) ? 0 : 1;
+    }
+    // --export-frames <games.txt | selfplay:N> <outdir> [WxH] [fps] [encoders]
+    if (argc >= 4 && string(argv[1]) == "--export-frames")
+    {
+        unsigned w = WINDOW_W, h = WINDOW_H;
+        if (argc >= 5 && sscanf(argv[4], "%ux%u", &w, &h) != 2)
+        {
+            cerr << "Resolution must look like 600x840\n";
+            return 1;
+        }
+        int fps = argc >= 6 ? max(1, atoi(argv[5])) : 30;
+        int encoders = argc >= 7 ? atoi(argv[6]) : (int)max(1u, thread::hardware_concurrency());
+        return runFrameExport(argv[2], argv[3], w, h, fps, encoders);
+    }
+    // --perft N K [depth] [position | -] [threads] [dedup]
+    if (argc >= 4 && string(argv[1]) == "--perft")
+    {
+        int n = atoi(argv[2]), k = atoi(argv[3]);
+        if (n < 3 || n > 5 || k < 3 || k > n)
+        {
+            cerr << "Usage: " << argv[0] << " --perft N K [depth] [position | -] [threads] [dedup]  (3 <= K <= N <= 5)\n";
+            return 1;
+        }
+        int depth = argc >= 5 ? atoi(argv[4]) : 0;
+        string position = argc >= 6 ? argv[5] : "-";
+        int threads = argc >= 7 ? atoi(argv[6]) : (int)max(1u, thread::hardware_concurrency());
+        bool dedup = argc >= 8 && string(argv[7]) == "dedup";
+        return runPerft(n, k, depth, position, threads, dedup);
+    }
+    // --tt-bench N K [megabytes] [threads] [position | -]
+    if (argc >= 4 && string(argv[1]) == "--tt-bench")
+    {
+        int n = atoi(argv[2]), k = atoi(argv[3]);
+        if (n < 3 || n > 5 || k < 3 || k > n)
+        {
+            cerr << "Usage: " << argv[0] << " --tt-bench N K [megabytes] [threads] [position | -]  (3 <= K <= N <= 5)\n";
+            return 1;
+        }
+        size_t mb = argc >= 5 ? (size_t)max(1, atoi(argv[4])) : 64;
+        int threads = argc >= 6 ? atoi(argv[5]) : (int)max(1u, thread::hardware_concurrency());
+        return runTTBenchmark(n, k, mb, threads, argc >= 7 ? argv[6] : "-");
+    }
+    // --rate [games.txt | synthetic:N] [K] [initial] [threads]
+    if (argc >= 2 && string(argv[1]) == "--rate")
+    {
+        RatingParams params;
+        if (argc >= 4)
+            params.k = max(1.0, atof(argv[3]));
+        if (argc >= 5)
+            params.initial = atof(argv[4]);
+        int threads = argc >= 6 ? atoi(argv[5]) : (int)max(1u, thread::hardware_concurrency());
+        return runRatingReplay(argc >= 3 ? argv[2] : "games.txt", params, threads);
+    }
+    // --ultimate-bench [ms per move] [games]
+    if (argc >= 2 && string(argv[1]) == "--ultimate-bench")
+        return runUltimateBenchmark(argc >= 3 ? max(1.0, atof(argv[2])) : 90.0, argc >= 4 ? max(0, atoi(argv[3])) : 10);
+    // --qubic-bench [ms per move] [games]
+    if (argc >= 2 && string(argv[1]) == "--qubic-bench")
+        return runQubicBenchmark(argc >= 3 ? max(1.0, atof(argv[2])) : 90.0, argc >= 4 ? max(0, atoi(argv[3])) : 10);
+    // --board-bench
+    if (argc >= 2 && string(argv[1]) == "--board-bench")
+        return runBoardBenchmark();
+    // --simul [boards] [easy|medium|hard] [auto]
+    if (argc >= 2 && string(argv[1]) == "--simul")
+    {
+        string diff = argc >= 4 ? argv[3] : "hard";
+        g_endgame.open(endgameFileName(BOARD_SIZE, WIN_LENGTH));
+        return runSimul(argc >= 3 ? max(1, min(1024, atoi(argv[2]))) : 256,
+            diff == "easy" ? Difficulty::Easy : diff == "medium" ? Difficulty::Medium : Difficulty::Hard,
+            argc >= 5 && string(argv[4]) == "auto");
+    }
+    // --bench-state [sessions]
+    if (argc >= 2 && string(argv[1]) == "--bench-state")
+        return runStateBenchmark(argc >= 3 ? (size_t)max(1L, atol(argv[2])) : 1000000);
+    // --server [tcp:PORT | unix:PATH] [workers]
+    // --loadgen [tcp:PORT | unix:PATH] [connections] [seconds] [easy|medium|hard]
+    if (argc >= 2 && (string(argv[1]) == "--server" || string(argv[1]) == "--loadgen"))
+    {
+        Endpoint ep;
+        if (!parseEndpoint(argc >= 3 ? argv[2] : "tcp:7777", ep))
+        {
+            cerr << "Bad endpoint; use tcp:PORT or unix:PATH\n";
+            return 1;
+        }
+        // the AI probes the same shared table as the windowed game
+        g_endgame.open(endgameFileName(BOARD_SIZE, WIN_LENGTH));
+        int hw = (int)max(1u, thread::hardware_concurrency());
+        if (string(argv[1]) == "--server")
+            return runServer(ep, argc >= 4 ? atoi(argv[3]) : hw);
+        return runLoadGenerator(ep, argc >= 4 ? max(1, atoi(argv[3])) : 64, argc >= 5 ? atof(argv[4]) : 10.0,
+            argc >= 6 ? argv[5] : "hard");
+    }
+
+    // window flags: --startup-timing, --low-latency, --input-latency (report only), --no-ponder,
+    // --trace [file] (builds with -DTTT_TRACE)
+    bool lowLatency = false, reportLatency = false, ponder = true;
+    string traceFile;
+    for (int i = 1; i < argc; i++)
+    {
+        string a = argv[i];
+        if (a == "--startup-timing")
+            g_startup.enabled = true;
+        else if (a == "--low-latency")
+            lowLatency = reportLatency = true;
+        else if (a == "--input-latency")
+            reportLatency = true;
+        else if (a == "--no-ponder")
+            ponder = false;
+        else if (a == "--trace")
+            traceFile = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : "trace.json";
+    }
+#if defined(TTT_TRACE)
+    if (!traceFile.empty())
+    {
+        g_trace.start();
+        TRACE_THREAD("main");
+    }
+#else
+    if (!traceFile.empty())
+        cerr << "--trace needs a build with -DTTT_TRACE\n";
+#endif
+
+    // share the precomputed endgame pages with any other running game
+    g_endgame.open(endgameFileName(BOARD_SIZE, WIN_LENGTH));
+
     RenderWindow window(VideoMode(WINDOW_W, WINDOW_H), "Tic-Tac-Toe Neon", Style::Close);
     window.setFramerateLimit(60);
 
     Font font;
+    auto fontStart = chrono::steady_clock::now();
     if (!loadPreferredFont(font))
     {
         cerr << "Failed to load font; make sure a system font is available (arial.ttf etc.)\n";
@@ -851,34 +6977,58 @@ int main()
         { /* proceed - maybe default */
         }
     }
+    auto glyphStart = chrono::steady_clock::now();
+    // glyph rasterization uploads into the font texture, which needs this
+    // thread's GL context, so it runs here rather than on a worker
+    prewarmGlyphs(font);
+    g_startup.fontMs = StartupTimer::msBetween(fontStart, glyphStart);
+    g_startup.glyphMs = StartupTimer::msBetween(glyphStart, chrono::steady_clock::now());
+
+    // --low-latency: no coarse sleep limiter; FramePacer schedules each frame
+    // and samples input as late as it can. Menus keep the 60 fps limiter.
+    FramePacer pacer(60.0);
+    LatencyRecorder inputLatency;
+    chrono::steady_clock::time_point pendingInputAt;
+    bool pendingInput = false;
+    if (lowLatency)
+    {
+        window.setVerticalSyncEnabled(false);
+        window.setFramerateLimit(0);
+    }
 
     Game game;
     bool restartRequested = true;
 
-    // restart button top right
-    Button restartBtn(WINDOW_W - 90.f, BOARD_TOP / 2.f, 140.f, 40.f, Color(30, 30, 40), Color(200, 180, 40), 99, "Restart");
+    Button restartBtn = makeRestartButton();
 
     Clock neonClock, aiClock;
     bool aiWaiting = false;
 
-    auto getColorForPiece = [](Piece p) -> Color
-        {
-            if (p == Piece::X)
-                return Color(255, 120, 110);
-            if (p == Piece::O)
-                return Color(110, 190, 255);
-            return Color::White;
-        };
+    // leaderboard kept in memory between games; HUD text rebuilt only when dirty
+    LBMap leaderboard = loadLeaderboard();
+    RatingTable ratings = loadRatings();
+    Hud hud;
+    bool hudDirty = true;
+    HintAnalyzer hintAnalyzer;
+    bool showHints = false;
+    Ponderer ponderer;
+    ponderer.enabled = ponder;
 
     while (window.isOpen())
     {
         // ------------------- MENUS -------------------
         if (restartRequested)
         {
+            ponderer.clear(); // no searching behind the menus
+            if (lowLatency)
+                window.setFramerateLimit(60);
             // Player type
             int playerChoice = playerTypeMenu(window, font);
             game.humanVsAI = (playerChoice == 2);
 
+            // Classic, Ultimate or Qubic
+            game.mode = variantMenu(window, font);
+
             // Player symbol
             game.player1Piece = symbolMenu(window, font);
             game.player2Piece = (game.player1Piece == Piece::X) ? Piece::O : Piece::X;
@@ -913,12 +7063,27 @@ int main()
 
             restartRequested = false;
             aiWaiting = false;
+            hudDirty = true;
+            TRACE_INSTANT("game start");
+            if (lowLatency)
+            {
+                window.setFramerateLimit(0);
+                pacer.resync();
+            }
         }
 
+        TRACE_SCOPE("frame");
+
         // ------------------- EVENTS -------------------
+        // low-latency mode: sleep until just before this frame must start, so
+        // the events below are as fresh as possible when they are drawn
+        if (lowLatency)
+            pacer.waitForInputWindow();
+
         Event ev;
         while (window.pollEvent(ev))
         {
+            auto polledAt = chrono::steady_clock::now(); // SFML events carry no timestamp
             if (ev.type == Event::Closed)
             {
                 window.close();
@@ -927,7 +7092,7 @@ int main()
 
             if (ev.type == Event::MouseButtonPressed && ev.mouseButton.button == Mouse::Left)
             {
-                Vector2i mp = Mouse::getPosition(window);
+                Vector2i mp = clickPos(ev);
 
                 // Restart button
                 if (restartBtn.contains(mp))
@@ -946,18 +7111,24 @@ int main()
                 // Player turn click
                 if (!game.currentTurnIsAI && !game.finished)
                 {
-                    int m = mousePosToIndex(mp);
-                    if (m >= 0 && game.board[m] == Piece::Empty)
+                    int m;
+                    bool legal;
+                    if (game.mode == GameMode::Ultimate)
+                        legal = game.ultimateBoard.legal(m = mousePosToUltimateMove(mp));
+                    else if (game.mode == GameMode::Qubic)
+                        legal = game.qubicBoard.legal(m = mousePosToQubicMove(mp));
+                    else
                     {
-                        game.board[m] = game.turnPiece;
-                        checkFinish(game);
-                        if (!game.finished)
-                        {
-                            // Swap turn
-                            Piece other = (game.turnPiece == game.player1Piece) ? game.player2Piece : game.player1Piece;
-                            game.turnPiece = other;
-                            game.currentTurnIsAI = (game.humanVsAI && other == game.player2Piece);
-                        }
+                        m = mousePosToIndex(mp);
+                        legal = m >= 0 && game.board[m] == Piece::Empty;
+                    }
+                    if (legal)
+                    {
+                        applyMove(game, m);
+                        hudDirty = true;
+                        if (!pendingInput)
+                            pendingInputAt = polledAt;
+                        pendingInput = true;
                     }
                 }
             }
@@ -965,6 +7136,12 @@ int main()
             // keyboard: press L to show full leaderboard file in terminal. (not opening editor here)
             if (ev.type == Event::KeyPressed)
             {
+                if (ev.key.code == Keyboard::H)
+                    showHints = !showHints; // H toggles the move-value overlay
+#if defined(TTT_TRACE)
+                if (ev.key.code == Keyboard::T && g_trace.enabled.load(memory_order_relaxed))
+                    g_trace.write(traceFile); // T writes the timeline so far
+#endif
                 if (ev.key.code == Keyboard::L)
                 {
                     // No external launching, we'll just print to terminal and you can open leaderboard.txt externally
@@ -989,102 +7166,75 @@ int main()
             {
                 aiClock.restart();
                 aiWaiting = true;
+                ponderer.stop(); // the human has moved
             }
             if (aiClock.getElapsedTime().asSeconds() >= 0.18f)
             {
-                int move = chooseAIMove(game);
+                int move = ponderer.take(game);
+                if (move < 0)
+                    move = chooseAIMove(game);
                 if (move >= 0)
                 {
-                    game.board[move] = game.turnPiece;
-                    checkFinish(game);
-                    if (!game.finished)
-                    {
-                        game.turnPiece = (game.turnPiece == game.player1Piece) ? game.player2Piece : game.player1Piece;
-                        game.currentTurnIsAI = false;
-                    }
+                    applyMove(game, move);
+                    hudDirty = true;
                 }
                 aiWaiting = false;
             }
         }
 
+        // the human's turn: search the AI's likely replies in the background
+        else if (!game.finished && game.humanVsAI)
+            ponderer.start(game);
+
         // If game just finished, update leaderboard once
         if (game.finished && !game.leaderboardUpdated)
         {
             updateLeaderboardOnFinish(game);
+            updateRatingsOnFinish(ratings, game);
+            if (game.mode == GameMode::Classic) // records hold classic games only
+                appendGameRecord(game);
+            leaderboard = loadLeaderboard();
+            hudDirty = true;
         }
 
         // ------------------- RENDERING -------------------
         float t = neonClock.getElapsedTime().asSeconds();
-        window.clear();
-        renderBoard(window, game, t, font);
-
-        // Player labels (top-left)
-        Text p1(game.player1Name + " (" + string((game.player1Piece == Piece::X) ? "X" : "O") + ")", font, 18);
-        p1.setFillColor(getColorForPiece(game.player1Piece));
-        p1.setPosition(12, 12);
-        window.draw(p1);
-
-        Text p2(game.player2Name + " (" + string((game.player2Piece == Piece::X) ? "X" : "O") + ")", font, 18);
-        p2.setFillColor(getColorForPiece(game.player2Piece));
-        p2.setPosition(12, 36);
-        window.draw(p2);
-
-        // show small leaderboard summary in footer for the two current players
-        LBMap board = loadLeaderboard();
-        string key1 = game.player1Name;
-        string key2 = game.player2Name;
-        if (game.humanVsAI && key2 == "AI")
-            key2 = aiNameForDifficulty(game.difficulty);
-
-        string summary1 = leaderboardSummaryFor(board, key1);
-        string summary2 = leaderboardSummaryFor(board, key2);
-
-        Text lb1(key1 + ": " + summary1, font, 16);
-        lb1.setFillColor(Color::White);
-        lb1.setPosition(12, BOARD_TOP + GAP + BOARD_SIZE * (CELL_PIX + GAP) + 40);
-        window.draw(lb1);
-
-        Text lb2(key2 + ": " + summary2, font, 16);
-        lb2.setFillColor(Color::White);
-        lb2.setPosition(12, BOARD_TOP + GAP + BOARD_SIZE * (CELL_PIX + GAP) + 60);
-        window.draw(lb2);
-
-        // Current turn or winner (top center)
-        Text topText("", font, 30);
-        if (game.finished)
+        if (hudDirty)
         {
-            if (game.winner == Piece::Empty)
-            {
-                topText.setString("DRAW!");
-                topText.setFillColor(Color::White);
-            }
-            else
-            {
-                string name = (game.winner == game.player1Piece) ? game.player1Name : game.player2Name;
-                topText.setString(name + " WINS!");
-                topText.setFillColor(getColorForPiece(game.winner));
-            }
+            hud.refresh(game, leaderboard, ratings, font);
+            hudDirty = false;
         }
-        else
+        // hints for a human's turn; analysis gets a slice of the 16 ms frame
+        const CellHints* hints = nullptr;
+        if (showHints && game.mode == GameMode::Classic && !game.finished && !game.currentTurnIsAI)
+            hints = &hintAnalyzer.update(game, 4.0);
         {
-            string currName = (game.turnPiece == game.player1Piece) ? game.player1Name : game.player2Name;
-            currName += " (" + string((game.turnPiece == Piece::X) ? "X" : "O") + ")";
-            topText.setString(currName);
-            Color c = getColorForPiece(game.turnPiece);
-            int alpha = 150 + 100 * abs(sin(t * 4.f)); // neon pulse
-            topText.setFillColor(Color(c.r, c.g, c.b, (sf::Uint8)alpha));
+            TRACE_SCOPE("render");
+            renderFrame(window, game, hud, restartBtn, t, font, hints);
         }
-
-        FloatRect r = topText.getLocalBounds();
-        topText.setOrigin(r.left + r.width / 2.f, r.top + r.height / 2.f);
-        topText.setPosition(WINDOW_W / 2.f, 60.f);
-        window.draw(topText);
-
-        // Restart button (top-right)
-        restartBtn.draw(window, t, font, 18);
-
-        window.display();
+        {
+            TRACE_SCOPE("display");
+            window.display();
+        }
+        g_startup.framePresented();
+        if (lowLatency)
+            pacer.framePresented();
+        if (pendingInput && reportLatency)
+            inputLatency.add(StartupTimer::msBetween(pendingInputAt, chrono::steady_clock::now()));
+        pendingInput = false;
+#if defined(TTT_TRACE)
+        if (g_trace.enabled.load(memory_order_relaxed))
+            g_trace.tick();
+#endif
     }
 
+    if (reportLatency)
+        inputLatency.report(cout, lowLatency ? "low-latency" : "default");
+    ponderer.stop();
+    ponderer.report(cout);
+#if defined(TTT_TRACE)
+    if (g_trace.enabled.load(memory_order_relaxed))
+        g_trace.write(traceFile);
+#endif
     return 0;
 }